@@ -2,6 +2,8 @@
 
 #include "utilities.h"
 
+#include "RenderStats.h"
+
 class AABB {
 public:
 	Interval x, y, z;
@@ -25,23 +27,29 @@ public:
 		return x;
 	}
 
+	// branchless slab test: the ray's precomputed sign picks the near and far plane of every axis
 	bool hit(const Ray& r, Interval ray_t) const {
-		for (int a = 0; a < 3; a++) {
-			auto invD = 1.0 / r.direction()[a]; // inverted direction
-			auto orig = r.origin()[a];
-
-			auto t0 = (axis(a).min - orig) * invD;
-			auto t1 = (axis(a).max - orig) * invD;
+		SRT_STAT(aabb_tests);
+		const Point3& orig = r.origin();
+		const Vec3& inv_dir = r.inv_direction();
 
-			// check whether direction is negative. if so, swap the t0 and t1.
-			if (invD < 0.0) std::swap(t0, t1);
+		for (int a = 0; a < 3; a++) {
+			const Interval& slab = axis(a);
+			auto t0 = ((r.sign(a) ? slab.max : slab.min) - orig[a]) * inv_dir[a];
+			auto t1 = ((r.sign(a) ? slab.min : slab.max) - orig[a]) * inv_dir[a];
 
-			if(t0 > ray_t.min) ray_t.min = t0;
-			if (t1 < ray_t.max) ray_t.max = t1;
-			
-			if (ray_t.max <= ray_t.min) return false;
+			// a NaN slab (0 * inf) leaves the interval untouched
+			ray_t.min = (t0 > ray_t.min) ? t0 : ray_t.min;
+			ray_t.max = (t1 < ray_t.max) ? t1 : ray_t.max;
 		}
-		return true;
+		return ray_t.min < ray_t.max;
+	}
+
+	double surface_area() const {
+		auto dx = x.size();
+		auto dy = y.size();
+		auto dz = z.size();
+		return 2 * (dx * dy + dy * dz + dz * dx);
 	}
 
 	AABB pad() {
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "utilities.h"
+
+#include "BVH.h"
+#include "HittableList.h"
+#include "LinearBVH.h"
+#include "WideBVH.h"
+
+#include <iostream>
+#include <string>
+
+/*
+	BVHType
+	- selects which acceleration structure is built over a scene, so they can be benchmarked side by side
+*/
+enum class BVHType
+{
+	Node,   // BVHNode: tree of individually allocated nodes
+	Linear, // LinearBVH: flattened node array
+	BVH4,   // WideBVH<4>: LinearBVH collapsed to 4 children per node, SSE box tests
+	BVH8,   // WideBVH<8>: LinearBVH collapsed to 8 children per node, AVX box tests
+};
+
+inline const char* split_method_name(BVHSplitMethod method) {
+	return (method == BVHSplitMethod::SAH) ? "sah" : "median";
+}
+
+// build options only apply to the structures with a configurable builder
+inline shared_ptr<Hittable> make_bvh(const HittableList& list, BVHType type, const BVHBuildOptions& options = BVHBuildOptions()) {
+	switch (type) {
+	case BVHType::Linear: {
+		auto bvh = make_shared<LinearBVH>(list, options);
+		std::clog << "LinearBVH (" << split_method_name(options.split_method) << "): " << bvh->node_count()
+			<< " nodes, SAH cost " << bvh->sah_cost() << '\n';
+		return bvh;
+	}
+	case BVHType::BVH4: {
+		LinearBVH binary(list, options);
+		auto bvh = make_shared<BVH4>(binary);
+		std::clog << "BVH4 (" << split_method_name(options.split_method) << "): " << bvh->node_count()
+			<< " nodes collapsed from " << binary.node_count() << '\n';
+		return bvh;
+	}
+	case BVHType::BVH8: {
+		LinearBVH binary(list, options);
+		auto bvh = make_shared<BVH8>(binary);
+		std::clog << "BVH8 (" << split_method_name(options.split_method) << "): " << bvh->node_count()
+			<< " nodes collapsed from " << binary.node_count() << '\n';
+		return bvh;
+	}
+	case BVHType::Node:
+	default:
+		return make_shared<BVHNode>(list);
+	}
+}
+
+inline const char* bvh_type_name(BVHType type) {
+	switch (type) {
+	case BVHType::Linear: return "linear";
+	case BVHType::BVH4: return "bvh4";
+	case BVHType::BVH8: return "bvh8";
+	case BVHType::Node:
+	default: return "node";
+	}
+}
+
+// returns false when the name is unknown
+inline bool split_method_from_name(const std::string& name, BVHSplitMethod& method) {
+	if (name == "median") { method = BVHSplitMethod::Median; return true; }
+	if (name == "sah") { method = BVHSplitMethod::SAH; return true; }
+	return false;
+}
+
+// returns false when the name is unknown
+inline bool bvh_type_from_name(const std::string& name, BVHType& type) {
+	if (name == "node") { type = BVHType::Node; return true; }
+	if (name == "linear") { type = BVHType::Linear; return true; }
+	if (name == "bvh4") { type = BVHType::BVH4; return true; }
+	if (name == "bvh8") { type = BVHType::BVH8; return true; }
+	return false;
+}
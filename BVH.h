@@ -4,6 +4,7 @@
 
 #include "Hittable.h"
 #include "HittableList.h"
+#include "RenderStats.h"
 
 #include <algorithm>
 
@@ -17,8 +18,40 @@ private:
 public :
 	BVHNode(const HittableList& list) : BVHNode(list.objects, 0, list.objects.size()) {}
 	BVHNode(const std::vector<shared_ptr<Hittable>>& src_objects, size_t start, size_t end) {
-		auto objects = src_objects;
+		auto objects = src_objects; // copied once, then sorted in place range by range
+		build(objects, start, end);
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+		SRT_STAT(bvh_nodes_visited);
+		if (!bbox.hit(r, ray_t))
+			return false;
+
+		// sub-volume hit test.
+		bool hit_left = left->hit(r, ray_t, rec);
+		bool hit_right = right->hit(r, Interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+
+		return hit_left || hit_right;
+	}
+
+	AABB bounding_box() const override {
+		return bbox;
+	}
+
+	void bind_materials(MaterialTable& table) const override {
+		left->bind_materials(table);
+		if (right != left)
+			right->bind_materials(table);
+	}
+private:
+	struct InPlace {};
+
+	BVHNode(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end, InPlace) {
+		build(objects, start, end);
+	}
 
+	// only reorders objects[start, end), so sibling subtrees never see each other's objects
+	void build(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end) {
 		int axis = random_int(0, 2);
 		auto comparator = (axis == 0) ? box_x_compare
 						: (axis == 1) ? box_y_compare
@@ -39,31 +72,16 @@ public :
 			}
 		}
 		else {
-			std::sort(objects.begin(), objects.end(), comparator); // sort by minimum boundary of bounding boxes
+			std::sort(objects.begin() + start, objects.begin() + end, comparator); // sort by minimum boundary of bounding boxes
 
 			auto mid = start + object_span / 2;
-			left = make_shared<BVHNode>(objects, start, mid);
-			right = make_shared<BVHNode>(objects, mid, end);
+			left = shared_ptr<BVHNode>(new BVHNode(objects, start, mid, InPlace()));
+			right = shared_ptr<BVHNode>(new BVHNode(objects, mid, end, InPlace()));
 		}
 
 		bbox = AABB(left->bounding_box(), right->bounding_box());
 	}
 
-	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
-		if (!bbox.hit(r, ray_t))
-			return false;
-
-		// sub-volume hit test.
-		bool hit_left = left->hit(r, ray_t, rec);
-		bool hit_right = right->hit(r, Interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
-
-		return hit_left || hit_right;
-	}
-
-	AABB bounding_box() const override {
-		return bbox;
-	}
-private:
 	static bool box_compare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b, int axis_index) {
 		return a->bounding_box().axis(axis_index).min < b->bounding_box().axis(axis_index).min;
 	}
@@ -1,12 +1,26 @@
 #pragma once
 #include "utilities.h"
 
+#include "CancellationToken.h"
+#include "Checkpoint.h"
 #include "Color.h"
+#include "Framebuffer.h"
+#include "Heatmap.h"
 #include "Hittable.h"
 #include "Material.h"
+#include "MaterialTable.h"
+#include "RenderStats.h"
+#include "TileScheduler.h"
+#include "WavefrontQueues.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
 
 /*
 	Camera class
@@ -20,6 +34,7 @@ public:
 	int image_width = 100;
 	int samples_per_pixel = 10;
 	int max_depth = 10;
+	int russian_roulette_depth = 3; // bounces before russian roulette may end a path, negative disables it
 
 	double fov = 90.0;
 	Point3 lookfrom = Point3(0, 0, -1);
@@ -29,28 +44,200 @@ public:
 	double defocus_angle = 0;
 	double focus_dist = 10;
 
+	std::string output_path = "output.ppm"; // format follows the extension: .ppm (binary P6), .pfm or .raw. empty = no image
+	bool accumulate = false; // keep the samples of the previous render() and add samples_per_pixel more to every pixel
+
+	int thread_count = 0; // 0 = one worker per hardware thread
+	int tile_size = 16;
+	unsigned int seed = 0; // same seed, same image - regardless of thread count and tile size
+
+	// adaptive sampling: samples_per_pixel becomes the maximum, a pixel stops once its estimate is confident enough
+	bool adaptive_sampling = false;
+	int adaptive_min_samples = 16;
+	double adaptive_threshold = 0.02; // 95% confidence half-width of the luminance, relative to its mean
+
+	// progressive rendering: every pass adds one sample to every pixel until samples_per_pixel is reached,
+	// and output_path is rewritten along the way as a preview
+	bool progressive = false;
+	int progressive_flush_passes = 0; // rewrite the output every N passes, 0 = not by pass count
+	double progressive_flush_seconds = 5.0; // rewrite the output once T seconds passed since the last write, 0 = not by time
+
+	// stopping early: workers check both between samples, render() then writes whatever has been accumulated
+	double time_budget = 0; // seconds of wall clock, 0 = no limit
+	const CancellationToken* cancellation = nullptr; // cancel() it from another thread to stop the render
+
+	// checkpoints: the render state is saved to checkpoint_path every checkpoint_seconds and when render() returns.
+	// with resume set, render() continues from that file and finishes with the same image an uninterrupted render gives
+	std::string checkpoint_path; // empty = no checkpoints
+	double checkpoint_seconds = 300;
+	bool resume = false;
+
+	// debug output: per pixel cost of this render(), written as a false color <output>_cost.ppm
+	CostMetric cost_heatmap = CostMetric::Off;
+
+	// scatter through a MaterialTable built from the world, false keeps the virtual Material::scatter
+	bool use_material_table = true;
+
+	// shade in batches: a tile takes one sample in all of its pixels at a time, and the hits of every bounce are
+	// sorted by material id and scattered material by material. the image is the same, end_frame() prints the
+	// shading throughput of every material
+	bool sort_by_material = false;
+
+	// ray packets: the camera rays of packet_size x packet_size pixel blocks (up to 8) are traced as one packet,
+	// which an accelerator may walk together. bounces are traced ray by ray. 0 = no packets, same image either way.
+	// used by the tiled renderer without sort_by_material. only LinearBVH walks a packet together, BVHNode and
+	// WideBVH trace its rays one by one
+	int packet_size = 0;
+
+	// wavefront integrator: the frame is rendered in batches of up to wavefront_batch_size paths instead of tiles,
+	// one sample per pixel per round. every bounce runs as stages over structure of arrays queues (generate,
+	// extend, shade), each stage spread over all worker threads. same image as the tiled renderer
+	bool wavefront = false;
+	int wavefront_batch_size = 1 << 16;
+
 	void render(const Hittable& world) {
+		begin_frame();
+		prepare_materials(world);
+
+		if (wavefront)
+			render_wavefront(world);
+		else if (progressive)
+			render_progressive(world);
+		else
+			render_tiles(world);
+
+		end_frame();
+	}
+
+	// render() in three steps, for renderers that hand tiles out themselves (DistributedRenderer):
+	// begin_frame() sets up the camera and the frame, render_region() or merge_pixel() fill it
+	// and end_frame() writes the output
+	void begin_frame() {
 		initialize();
 
-		std::ofstream outputFile("output.ppm");
-		outputFile << "P3\n" << image_width << " " << image_height << "\n255\n";
+		if (!accumulate || framebuffer.width() != image_width || framebuffer.height() != image_height)
+			framebuffer.resize(image_width, image_height);
 
-		for (int j = 0; j < image_height; ++j) {
-			std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-			for (int i = 0; i < image_width; ++i) {
-				Color3 pixel_color(0, 0, 0);
-				for (int sample = 0; sample < samples_per_pixel; sample++) {
-					Ray r = get_ray(i, j);
-					pixel_color += ray_color(r, max_depth, world);
-				}
-				write_color(outputFile, pixel_color, samples_per_pixel);
-			}
+		estimates.assign(framebuffer.pixel_count(), PixelEstimate());
+		if (resume && !checkpoint_path.empty())
+			load_checkpoint();
+		worker_stats.clear();
+		rays_traced = 0;
+		material_world = nullptr;
+		shading_stats.clear();
+		pixel_costs.clear();
+		if (cost_heatmap != CostMetric::Off && wavefront)
+			std::cerr << "ERROR: The wavefront integrator does not record per pixel costs, no heatmap is written.\n";
+		else if (cost_heatmap != CostMetric::Off)
+			pixel_costs.assign(framebuffer.pixel_count(), 0.0);
+#if !defined(SRT_ENABLE_STATS)
+		if (cost_heatmap == CostMetric::NodeVisits)
+			std::cerr << "ERROR: Node visit heatmaps need a build with SRT_ENABLE_STATS, falling back to time.\n";
+#endif
+#if defined(SRT_ENABLE_STATS)
+		RenderStats::reset();
+#endif
+		render_start = std::chrono::steady_clock::now();
+		last_checkpoint = render_start;
+	}
+
+	// renders one tile on the calling thread
+	void render_region(const Hittable& world, const Tile& tile) {
+		prepare_materials(world);
+		rays_traced += render_tile(tile, world, samples_per_pixel);
+	}
+
+	// stores a pixel rendered somewhere else, it counts as done
+	void merge_pixel(size_t pixel, const Color3& color_sum, int samples) {
+		framebuffer.set_pixel(pixel, color_sum, samples);
+		estimates[pixel].samples = samples;
+		estimates[pixel].converged = true;
+	}
+
+	void end_frame() {
+		write_output();
+		if (!checkpoint_path.empty())
+			Checkpoint::write(checkpoint_path, seed, framebuffer, estimates);
+		if (!pixel_costs.empty() && !output_path.empty())
+			Heatmap::write(Framebuffer::sibling_path(output_path, "_cost", ".ppm"), image_width, image_height, pixel_costs);
+
+		stopped = !finished();
+
+		std::clog << (stopped ? "\rStopped early        " : "\rDone                 ") << std::flush;
+
+		if (adaptive_sampling || stopped) {
+			long long total = 0;
+			for (size_t p = 0; p < framebuffer.pixel_count(); p++)
+				total += framebuffer.sample_count(p);
+			std::clog << "\nAverage samples per pixel: " << static_cast<double>(total) / framebuffer.pixel_count();
+		}
+
+		print_worker_stats();
+		if (sort_by_material)
+			print_shading_stats();
+
+#if defined(SRT_ENABLE_STATS)
+		render_stats = RenderStats::snapshot();
+		render_stats.print(std::clog);
+		if (!output_path.empty()) {
+			std::ofstream json(Framebuffer::sibling_path(output_path, "_stats", ".json"));
+			json << render_stats.to_json();
 		}
-		std::clog << "\rDone                 "<< std::flush;
+#endif
+	}
+
+	// busy/idle time of every render worker during the last render(), summed over all passes
+	const std::vector<WorkStealingScheduler::WorkerStats>& get_worker_stats() const { return worker_stats; }
+
+	// accumulated linear samples and per pixel sample counts of the last render()
+	const Framebuffer& get_framebuffer() const { return framebuffer; }
+
+	// ray and intersection counters of the last render(), all zero unless built with SRT_ENABLE_STATS
+	const RenderStats& get_render_stats() const { return render_stats; }
+
+	// scatters and shading time of every material during the last render() with sort_by_material, indexed by HitRecord::material_id
+	const std::vector<MaterialShadingStats>& get_shading_stats() const { return shading_stats; }
+
+	// get_shading_stats() summed over the materials of each type, in order of first appearance
+	std::vector<std::pair<std::string, MaterialShadingStats>> get_shading_stats_by_type() const {
+		std::vector<std::pair<std::string, MaterialShadingStats>> types;
+		for (size_t id = 0; id < shading_stats.size(); id++) {
+			if (shading_stats[id].scatters == 0)
+				continue;
+			std::string name = material_name(static_cast<uint32_t>(id));
+			auto type = std::find_if(types.begin(), types.end(), [&](const std::pair<std::string, MaterialShadingStats>& t) { return t.first == name; });
+			if (type == types.end())
+				type = types.insert(types.end(), std::make_pair(name, MaterialShadingStats()));
+			type->second += shading_stats[id];
+		}
+		return types;
+	}
+
+	// type name of a material of the last render()
+	const char* material_name(uint32_t id) const {
+		return materials.contains(id) ? material_type_name(materials.entry(id).type) : "unknown";
 	}
 
+	// rays traced by this process during the last render(), camera rays and every bounce
+	long long get_ray_count() const { return rays_traced; }
+
+	// true when the last render() ran out of time_budget or was cancelled before every pixel got its samples
+	bool stopped_early() const { return stopped; }
+
 private:
 	int image_height;
+	Framebuffer framebuffer;
+	std::vector<PixelEstimate> estimates;
+	std::chrono::steady_clock::time_point render_start;
+	std::chrono::steady_clock::time_point last_checkpoint;
+	bool stopped = false;
+	long long rays_traced = 0;
+	RenderStats render_stats;
+	std::vector<double> pixel_costs; // empty unless cost_heatmap is on
+	MaterialTable materials;
+	std::vector<MaterialShadingStats> shading_stats;
+	const Hittable* material_world = nullptr; // the world materials was built from this frame
+	std::vector<WorkStealingScheduler::WorkerStats> worker_stats;
 	Point3 center;
 	Point3 pixel00_loc;
 	Vec3 pixel_delta_u;
@@ -93,42 +280,732 @@ private:
 		defocus_disk_v = v * defocus_radius;
 	}
 
-	Color3 ray_color(const Ray& r, int depth, const Hittable& world) const {
-		if (depth <= 0)
-			return Color3(0, 0, 0);
+	// every tile takes all of its samples at once, the image is written when the last tile is done.
+	// a due checkpoint makes the workers hand their tiles back, the next round picks up every pixel where it stopped
+	void render_tiles(const Hittable& world) {
+		TileScheduler scheduler(image_width, image_height, tile_size);
+
+		while (true) {
+			int tiles_remaining = static_cast<int>(scheduler.get_tiles().size());
+			std::mutex progress_mutex;
+
+			scheduler.run(thread_count, [&](const Tile& tile) {
+				long long rays = render_tile(tile, world, samples_per_pixel);
+
+				std::lock_guard<std::mutex> lock(progress_mutex);
+				rays_traced += rays;
+				tiles_remaining--;
+				std::clog << "\rTiles remaining: " << tiles_remaining << ' ' << std::flush;
+			});
+			add_worker_stats(scheduler.get_worker_stats());
+
+			if (finished() || should_stop())
+				break;
+			save_checkpoint();
+		}
+	}
+
+	// one sample per pixel per pass, so the whole image refines evenly and can be previewed at any point
+	void render_progressive(const Hittable& world) {
+		TileScheduler scheduler(image_width, image_height, tile_size);
+		auto last_write = render_start;
+
+		// a resumed render continues its pass count
+		int first_pass = samples_per_pixel;
+		for (const auto& estimate : estimates)
+			first_pass = std::min(first_pass, estimate.samples);
+
+		for (int pass = first_pass + 1; ; pass++) {
+			std::atomic<long long> pass_rays{ 0 };
+			scheduler.run(thread_count, [&](const Tile& tile) {
+				pass_rays += render_tile(tile, world, 1);
+			});
+			add_worker_stats(scheduler.get_worker_stats());
+			rays_traced += pass_rays;
+
+			std::clog << "\rPass " << pass << '/' << samples_per_pixel << ' ' << std::flush;
+
+			// every pixel is done, or the render was stopped: render() writes the final image
+			if (finished() || should_stop())
+				break;
+			if (checkpoint_due())
+				save_checkpoint();
+
+			auto now = std::chrono::steady_clock::now();
+
+			bool write_due = (progressive_flush_passes > 0 && pass % progressive_flush_passes == 0)
+				|| (progressive_flush_seconds > 0 && seconds_between(last_write, now) >= progressive_flush_seconds);
+			if (write_due) {
+				write_output();
+				last_write = now;
+			}
+		}
+	}
+
+	// every round takes one more sample in each pixel that is not done yet, a batch of pixels at a time.
+	// checkpoints are written between batches, every pixel of a finished batch is complete
+	void render_wavefront(const Hittable& world) {
+		WorkStealingScheduler scheduler(TileScheduler::resolve_thread_count(thread_count));
+		size_t batch_size = static_cast<size_t>(std::max(1, wavefront_batch_size));
+
+		PathBuffer paths;
+		HitBuffer hits;
+		RayQueue extend_queue;
+		RayQueue shade_queue;
+		ChunkScratch scratch;
+		paths.resize(batch_size);
+		hits.resize(batch_size);
+		extend_queue.reserve(batch_size);
+		shade_queue.reserve(batch_size);
+		scratch.reserve(batch_size);
+
+		// a resumed render continues its round count
+		int first_round = samples_per_pixel;
+		for (const auto& estimate : estimates)
+			first_round = std::min(first_round, estimate.samples);
+
+		std::vector<uint32_t> pending; // pixels that take a sample this round
+		for (int round = first_round + 1; ; round++) {
+			pending.clear();
+			for (size_t p = 0; p < estimates.size(); p++)
+				if (!pixel_done(estimates[p]))
+					pending.push_back(static_cast<uint32_t>(p));
+
+			for (size_t first = 0; first < pending.size() && !should_stop(); first += batch_size) {
+				size_t n = std::min(batch_size, pending.size() - first);
+				rays_traced += trace_wavefront(scheduler, &pending[first], n, world, paths, hits, extend_queue, shade_queue, scratch);
+				if (checkpoint_due())
+					save_checkpoint();
+			}
+
+			std::clog << "\rRound " << round << '/' << samples_per_pixel << ' ' << std::flush;
+
+			if (finished() || should_stop())
+				break;
+		}
+	}
+
+	// one sample in each of the n pixels: generate the camera rays, then extend and shade until every path ended,
+	// and add the results to the framebuffer. returns the number of rays traced
+	long long trace_wavefront(WorkStealingScheduler& scheduler, const uint32_t* pixels, size_t n, const Hittable& world,
+		PathBuffer& paths, HitBuffer& hits, RayQueue& extend_queue, RayQueue& shade_queue, ChunkScratch& scratch) {
+		// parallel_for cuts at multiples of grain, so begin / grain is the chunk's slot in scratch
+		const size_t grain = 1024;
+		std::atomic<long long> rays{ 0 };
+
+		// generate: a camera ray for every pixel, drawn from the stream of its next sample
+		extend_queue.resize(n);
+		scheduler.parallel_for(n, grain, [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; k++) {
+				int i = static_cast<int>(pixels[k] % image_width);
+				int j = static_cast<int>(pixels[k] / image_width);
+				paths.pixel[k] = pixels[k];
+				paths.rng[k] = RNG::for_pixel_sample(seed, i, j, framebuffer.sample_count(pixels[k]));
+				paths.set_ray(k, get_ray(i, j, paths.rng[k]));
+				paths.set_throughput(k, Color3(1, 1, 1));
+				paths.set_color(k, Color3(0, 0, 0));
+				extend_queue.set(k, static_cast<uint32_t>(k));
+			}
+		});
+		add_worker_stats(scheduler.get_worker_stats());
+
+		for (int depth = 0; depth < max_depth && extend_queue.size() > 0; depth++) {
+			// extend: closest hit of every live path, misses end with the background.
+			// with sort_by_material the hits are counted per material (ids outside the table share the last bucket)
+			size_t buckets = sort_by_material ? materials.size() + 1 : 1;
+			shade_queue.clear();
+			scratch.reset(extend_queue.size(), grain, buckets);
+			scheduler.parallel_for(extend_queue.size(), grain, [&](size_t begin, size_t end) {
+				uint32_t* hit_paths = &scratch.paths[begin];
+				size_t hit_count = 0;
+				long long chunk_rays = 0;
+				for (size_t q = begin; q < end; q++) {
+					uint32_t k = extend_queue[q];
+					Ray ray = paths.ray(k);
+					chunk_rays++;
+					if (depth == 0)
+						SRT_STAT(primary_rays);
+					else
+						SRT_STAT(secondary_rays);
+
+					HitRecord rec;
+					if (!world.hit(ray, Interval(0.001, infinity), rec)) {
+						SRT_STAT_PATH(depth + 1);
+						paths.set_color(k, paths.throughput(k) * background(ray));
+						continue;
+					}
+					SRT_STAT(ray_hits);
+					hits.set(k, rec);
+					hit_paths[hit_count++] = k;
+					if (sort_by_material)
+						scratch.counts[begin / grain * buckets + std::min<size_t>(rec.material_id, buckets - 1)]++;
+				}
+				if (sort_by_material)
+					scratch.sizes[begin / grain] = hit_count;
+				else
+					shade_queue.push(hit_paths, hit_count);
+				rays += chunk_rays;
+			});
+			add_worker_stats(scheduler.get_worker_stats());
+
+			// counting sort: every chunk copies its hits to the runs place() gave it, in the order it found them
+			if (sort_by_material) {
+				shade_queue.resize(scratch.place());
+				scheduler.parallel_for(extend_queue.size(), grain, [&](size_t begin, size_t) {
+					size_t* next = &scratch.counts[begin / grain * buckets];
+					for (size_t s = begin; s < begin + scratch.sizes[begin / grain]; s++) {
+						uint32_t k = scratch.paths[s];
+						shade_queue.set(next[std::min<size_t>(hits.material_id[k], buckets - 1)]++, k);
+					}
+				});
+				add_worker_stats(scheduler.get_worker_stats());
+			}
+
+			// shade: scatter every hit, the survivors of russian roulette go on to the next bounce
+			extend_queue.clear();
+			scheduler.parallel_for(shade_queue.size(), grain, [&](size_t begin, size_t end) {
+				uint32_t* survivors = &scratch.paths[begin];
+				size_t survivor_count = 0;
+				for (size_t q = begin; q < end; ) {
+					// with sort_by_material the queue is made of runs of one material, each is timed on its own
+					uint32_t id = hits.material_id[shade_queue[q]];
+					size_t run_end = sort_by_material ? q + 1 : end;
+					while (run_end < end && hits.material_id[shade_queue[run_end]] == id)
+						run_end++;
+					size_t run_begin = q;
+					auto start = std::chrono::steady_clock::now();
+
+					for (; q < run_end; q++) {
+						uint32_t k = shade_queue[q];
+						HitRecord rec = hits.record(k);
+						Ray scattered;
+						Color3 atteunation;
+						if (!scatter(paths.ray(k), rec, atteunation, scattered, paths.rng[k])) {
+							SRT_STAT_PATH(depth + 1);
+							continue;
+						}
+
+						Color3 throughput = paths.throughput(k) * atteunation;
+						bool survives = russian_roulette(throughput, depth, paths.rng[k]);
+						paths.set_throughput(k, throughput);
+						paths.set_ray(k, scattered);
+						if (!survives) {
+							SRT_STAT_PATH(depth + 1);
+							continue;
+						}
+						survivors[survivor_count++] = k;
+					}
+
+					if (sort_by_material) {
+						double seconds = seconds_between(start, std::chrono::steady_clock::now());
+						std::lock_guard<std::mutex> lock(shading_mutex());
+						if (shading_stats.size() <= id)
+							shading_stats.resize(id + 1);
+						shading_stats[id].scatters += static_cast<long long>(run_end - run_begin);
+						shading_stats[id].seconds += seconds;
+					}
+				}
+				extend_queue.push(survivors, survivor_count);
+			});
+			add_worker_stats(scheduler.get_worker_stats());
+		}
+		for (size_t q = 0; q < extend_queue.size(); q++)
+			SRT_STAT_PATH(max_depth);
+
+		// accumulate: every pixel appears once in the batch, so the paths add to the framebuffer in parallel
+		scheduler.parallel_for(n, grain, [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; k++) {
+				size_t pixel = paths.pixel[k];
+				Color3 color = paths.color(k);
+				framebuffer.set_pixel(pixel, framebuffer.color_sum(pixel) + color, framebuffer.sample_count(pixel) + 1);
+
+				auto& estimate = estimates[pixel];
+				estimate.samples++;
+				if (adaptive_sampling)
+					update_estimate(estimate, color);
+			}
+		});
+		add_worker_stats(scheduler.get_worker_stats());
+
+		return rays;
+	}
+
+	// takes up to `samples` more samples in every pixel of the tile that is not done yet.
+	// returns the number of rays traced
+	long long render_tile(const Tile& tile, const Hittable& world, int samples) {
+		if (sort_by_material)
+			return render_tile_sorted(tile, world, samples);
+		if (packet_size > 1)
+			return render_tile_packets(tile, world, samples);
+
+		long long rays = 0;
+		for (int j = tile.y0; j < tile.y1; ++j) {
+			for (int i = tile.x0; i < tile.x1; ++i) {
+				size_t pixel = framebuffer.index(i, j);
+				auto& estimate = estimates[pixel];
+				// keep summing onto the buffer, so splitting a render into rounds does not change the rounding
+				Color3 pixel_color = framebuffer.color_sum(pixel);
+				int sample = 0;
+				// samples already in the buffer keep their streams, new ones continue after them
+				int first_sample = framebuffer.sample_count(pixel);
+				double cost_start = pixel_costs.empty() ? 0 : pixel_cost_counter();
+
+				for (; sample < samples && !pixel_done(estimate) && !should_yield(); sample++) {
+					RNG rng = RNG::for_pixel_sample(seed, i, j, first_sample + sample);
+					Ray r = get_ray(i, j, rng);
+					Color3 sample_color = ray_color(r, world, rng, rays);
+					pixel_color += sample_color;
+					estimate.samples++;
+
+					if (adaptive_sampling)
+						update_estimate(estimate, sample_color);
+				}
+
+				framebuffer.set_pixel(pixel, pixel_color, first_sample + sample);
+				if (!pixel_costs.empty())
+					pixel_costs[pixel] += pixel_cost_counter() - cost_start;
+			}
+		}
+		return rays;
+	}
+
+	// render_tile() with packet_size: block by block, every sample traces the camera rays of the block's pixels
+	// that are not done yet as one packet
+	long long render_tile_packets(const Tile& tile, const Hittable& world, int samples) {
+		const int side = std::min(packet_size, 8);
+		long long rays = 0;
+
+		for (int y0 = tile.y0; y0 < tile.y1; y0 += side) {
+			for (int x0 = tile.x0; x0 < tile.x1; x0 += side) {
+				int width = std::min(side, tile.x1 - x0);
+				int block_pixels = width * std::min(side, tile.y1 - y0);
+				auto pixel_of = [&](int k) { return framebuffer.index(x0 + k % width, y0 + k / width); };
+
+				Color3 sums[RayPacket::max_size];
+				int first_samples[RayPacket::max_size];
+				int taken[RayPacket::max_size] = {};
+				for (int k = 0; k < block_pixels; k++) {
+					sums[k] = framebuffer.color_sum(pixel_of(k));
+					first_samples[k] = framebuffer.sample_count(pixel_of(k));
+				}
+				double cost_start = pixel_costs.empty() ? 0 : pixel_cost_counter();
+
+				for (int sample = 0; sample < samples && !should_yield(); sample++) {
+					RayPacket packet;
+					RNG rngs[RayPacket::max_size];
+					int lane_pixel[RayPacket::max_size];
+					for (int k = 0; k < block_pixels; k++) {
+						if (pixel_done(estimates[pixel_of(k)]))
+							continue;
+						int lane = packet.size;
+						lane_pixel[lane] = k;
+						rngs[lane] = RNG::for_pixel_sample(seed, x0 + k % width, y0 + k / width, first_samples[k] + taken[k]);
+						packet.add(get_ray(x0 + k % width, y0 + k / width, rngs[lane]));
+					}
+					if (packet.size == 0)
+						break;
+
+					HitRecord recs[RayPacket::max_size];
+					Interval ray_ts[RayPacket::max_size];
+					for (int lane = 0; lane < packet.size; lane++)
+						ray_ts[lane] = Interval(0.001, infinity);
+					uint64_t hits = world.hit_packet(packet, ray_ts, recs);
+
+					for (int lane = 0; lane < packet.size; lane++) {
+						int k = lane_pixel[lane];
+						if (!((hits >> lane) & 1))
+							recs[lane].mat = nullptr;
+						Color3 sample_color = ray_color(packet.rays[lane], world, rngs[lane], rays, &recs[lane]);
+						sums[k] += sample_color;
+						taken[k]++;
+
+						auto& estimate = estimates[pixel_of(k)];
+						estimate.samples++;
+						if (adaptive_sampling)
+							update_estimate(estimate, sample_color);
+					}
+				}
+
+				for (int k = 0; k < block_pixels; k++)
+					framebuffer.set_pixel(pixel_of(k), sums[k], first_samples[k] + taken[k]);
+
+				// the pixels of a block are traced together, they share its cost evenly
+				if (!pixel_costs.empty()) {
+					double cost = (pixel_cost_counter() - cost_start) / block_pixels;
+					for (int k = 0; k < block_pixels; k++)
+						pixel_costs[pixel_of(k)] += cost;
+				}
+			}
+		}
+		return rays;
+	}
+
+	// one path of render_tile_sorted()
+	struct PathState {
+		size_t tile_pixel; // row major within the tile
+		RNG rng;
+		Ray ray;
+		Color3 throughput;
+		Color3 color;
+		bool alive;
+	};
+
+	// render_tile() with sort_by_material: every wave takes one sample in each pixel that is not done yet.
+	// a path draws from its own stream in the same order either way, so the image does not change
+	long long render_tile_sorted(const Tile& tile, const Hittable& world, int samples) {
+		int tile_width = tile.x1 - tile.x0;
+		size_t tile_pixels = static_cast<size_t>(tile_width) * (tile.y1 - tile.y0);
+		auto pixel_of = [&](size_t k) { return framebuffer.index(tile.x0 + static_cast<int>(k) % tile_width, tile.y0 + static_cast<int>(k) / tile_width); };
+
+		std::vector<Color3> sums(tile_pixels);
+		std::vector<int> first_samples(tile_pixels);
+		std::vector<int> taken(tile_pixels, 0);
+		for (size_t k = 0; k < tile_pixels; k++) {
+			size_t pixel = pixel_of(k);
+			sums[k] = framebuffer.color_sum(pixel);
+			first_samples[k] = framebuffer.sample_count(pixel);
+		}
+		double cost_start = pixel_costs.empty() ? 0 : pixel_cost_counter();
+
+		long long rays = 0;
+		std::vector<PathState> paths;
+		std::vector<MaterialShadingStats> stats;
+		for (int sample = 0; sample < samples && !should_yield(); sample++) {
+			paths.clear();
+			for (size_t k = 0; k < tile_pixels; k++) {
+				int i = tile.x0 + static_cast<int>(k) % tile_width;
+				int j = tile.y0 + static_cast<int>(k) / tile_width;
+				if (pixel_done(estimates[pixel_of(k)]))
+					continue;
+
+				PathState path = { k, RNG::for_pixel_sample(seed, i, j, first_samples[k] + taken[k]), Ray(), Color3(1, 1, 1), Color3(0, 0, 0), true };
+				path.ray = get_ray(i, j, path.rng);
+				paths.push_back(path);
+			}
+			if (paths.empty())
+				break;
+
+			trace_sorted(paths, world, rays, stats);
+
+			for (const auto& path : paths) {
+				size_t k = path.tile_pixel;
+				auto& estimate = estimates[pixel_of(k)];
+				sums[k] += path.color;
+				taken[k]++;
+				estimate.samples++;
+
+				if (adaptive_sampling)
+					update_estimate(estimate, path.color);
+			}
+		}
+
+		for (size_t k = 0; k < tile_pixels; k++)
+			framebuffer.set_pixel(pixel_of(k), sums[k], first_samples[k] + taken[k]);
+
+		// the pixels of a tile are shaded together, they share its cost evenly
+		if (!pixel_costs.empty()) {
+			double cost = (pixel_cost_counter() - cost_start) / tile_pixels;
+			for (size_t k = 0; k < tile_pixels; k++)
+				pixel_costs[pixel_of(k)] += cost;
+		}
+
+		std::lock_guard<std::mutex> lock(shading_mutex());
+		if (shading_stats.size() < stats.size())
+			shading_stats.resize(stats.size());
+		for (size_t id = 0; id < stats.size(); id++)
+			shading_stats[id] += stats[id];
+		return rays;
+	}
+
+	// ray_color() for a batch of paths, bounce by bounce: trace every live path, then sort the hits by material id
+	// and scatter the paths of one material after another
+	void trace_sorted(std::vector<PathState>& paths, const Hittable& world, long long& rays, std::vector<MaterialShadingStats>& stats) const {
+		std::vector<HitRecord> hits(paths.size());
+		std::vector<uint64_t> order; // material id in the high half, path index in the low half
+		order.reserve(paths.size());
+
+		for (int depth = 0; depth < max_depth; depth++) {
+			order.clear();
+			for (size_t p = 0; p < paths.size(); p++) {
+				PathState& path = paths[p];
+				if (!path.alive)
+					continue;
+
+				rays++;
+				if (depth == 0)
+					SRT_STAT(primary_rays);
+				else
+					SRT_STAT(secondary_rays);
+
+				if (!world.hit(path.ray, Interval(0.001, infinity), hits[p])) {
+					SRT_STAT_PATH(depth + 1);
+					path.color = path.throughput * background(path.ray);
+					path.alive = false;
+					continue;
+				}
+				SRT_STAT(ray_hits);
+				order.push_back((static_cast<uint64_t>(hits[p].material_id) << 32) | p);
+			}
+			if (order.empty())
+				return;
+
+			std::sort(order.begin(), order.end());
+
+			for (size_t begin = 0; begin < order.size(); ) {
+				uint32_t id = static_cast<uint32_t>(order[begin] >> 32);
+				size_t end = begin;
+				while (end < order.size() && static_cast<uint32_t>(order[end] >> 32) == id)
+					end++;
+
+				auto start = std::chrono::steady_clock::now();
+				for (size_t o = begin; o < end; o++) {
+					PathState& path = paths[static_cast<uint32_t>(order[o])];
+					Ray scattered;
+					Color3 atteunation;
+					if (!scatter(path.ray, hits[static_cast<uint32_t>(order[o])], atteunation, scattered, path.rng)) {
+						SRT_STAT_PATH(depth + 1);
+						path.alive = false;
+						continue;
+					}
+
+					path.throughput = path.throughput * atteunation;
+					path.ray = scattered;
+					if (!russian_roulette(path.throughput, depth, path.rng)) {
+						SRT_STAT_PATH(depth + 1);
+						path.alive = false;
+					}
+				}
+
+				if (stats.size() <= id)
+					stats.resize(id + 1);
+				stats[id].scatters += static_cast<long long>(end - begin);
+				stats[id].seconds += seconds_between(start, std::chrono::steady_clock::now());
+				begin = end;
+			}
+		}
+
+		for (const auto& path : paths)
+			if (path.alive)
+				SRT_STAT_PATH(max_depth);
+	}
+
+	static std::mutex& shading_mutex() {
+		static std::mutex m;
+		return m;
+	}
+
+	// running total of the heatmap's cost metric on the calling thread
+	double pixel_cost_counter() const {
+#if defined(SRT_ENABLE_STATS)
+		if (cost_heatmap == CostMetric::NodeVisits)
+			return static_cast<double>(RenderStats::local().bvh_nodes_visited);
+#endif
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	bool pixel_done(const PixelEstimate& estimate) const {
+		return estimate.converged || estimate.samples >= samples_per_pixel;
+	}
+
+	bool finished() const {
+		for (const auto& estimate : estimates)
+			if (!pixel_done(estimate))
+				return false;
+		return true;
+	}
+
+	// a pixel converges once the 95% confidence interval of its mean luminance is narrow enough
+	void update_estimate(PixelEstimate& estimate, const Color3& sample_color) const {
+		int n = estimate.samples;
+		double delta = luminance(sample_color) - estimate.mean;
+		estimate.mean += delta / n;
+		estimate.m2 += delta * (luminance(sample_color) - estimate.mean);
+
+		if (n >= adaptive_min_samples && n > 1) {
+			double error = 1.96 * sqrt(estimate.m2 / (n - 1) / n);
+			if (error <= adaptive_threshold * fmax(estimate.mean, 1e-3))
+				estimate.converged = true;
+		}
+	}
+
+	bool should_stop() const {
+		if (cancellation && cancellation->is_cancelled())
+			return true;
+		return time_budget > 0 && seconds_between(render_start, std::chrono::steady_clock::now()) >= time_budget;
+	}
+
+	bool checkpoint_due() const {
+		return !checkpoint_path.empty() && checkpoint_seconds > 0
+			&& seconds_between(last_checkpoint, std::chrono::steady_clock::now()) >= checkpoint_seconds;
+	}
+
+	// workers hand their tile back between samples when the render has to stop or a checkpoint is due
+	bool should_yield() const {
+		return should_stop() || checkpoint_due();
+	}
+
+	void save_checkpoint() {
+		if (Checkpoint::write(checkpoint_path, seed, framebuffer, estimates))
+			std::clog << "\rCheckpoint written to " << checkpoint_path << '\n';
+		last_checkpoint = std::chrono::steady_clock::now();
+	}
+
+	// keeps the fresh buffer when the checkpoint does not belong to this image
+	void load_checkpoint() {
+		Framebuffer loaded;
+		std::vector<PixelEstimate> loaded_estimates;
+		unsigned int loaded_seed = 0;
+		if (!Checkpoint::read(checkpoint_path, loaded_seed, loaded, loaded_estimates))
+			return;
+
+		if (loaded.width() != image_width || loaded.height() != image_height || loaded_seed != seed) {
+			std::cerr << "ERROR: Checkpoint '" << checkpoint_path << "' was written for a different image size or seed.\n";
+			return;
+		}
+
+		framebuffer = std::move(loaded);
+		estimates = std::move(loaded_estimates);
+		std::clog << "Resuming from " << checkpoint_path << '\n';
+	}
+
+	// builds the material table once per frame, before any worker reads it
+	void prepare_materials(const Hittable& world) {
+		if (!(use_material_table || sort_by_material) || material_world == &world)
+			return;
+		materials.build(world);
+		material_world = &world;
+	}
+
+	void write_output() const {
+		if (output_path.empty())
+			return;
+		framebuffer.write(output_path);
+		if (adaptive_sampling)
+			framebuffer.write_sample_map(Framebuffer::sibling_path(output_path, "_samples", ".pgm"));
+	}
+
+	void add_worker_stats(const std::vector<WorkStealingScheduler::WorkerStats>& pass_stats) {
+		if (worker_stats.size() < pass_stats.size())
+			worker_stats.resize(pass_stats.size());
+		for (size_t w = 0; w < pass_stats.size(); w++) {
+			worker_stats[w].tasks_run += pass_stats[w].tasks_run;
+			worker_stats[w].tasks_stolen += pass_stats[w].tasks_stolen;
+			worker_stats[w].busy_seconds += pass_stats[w].busy_seconds;
+			worker_stats[w].idle_seconds += pass_stats[w].idle_seconds;
+		}
+	}
+
+	static double seconds_between(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+		return std::chrono::duration<double>(to - from).count();
+	}
+
+	static double luminance(const Color3& c) {
+		return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+	}
+
+	void print_worker_stats() const {
+		std::clog << '\n';
+		for (size_t w = 0; w < worker_stats.size(); w++) {
+			const auto& s = worker_stats[w];
+			std::clog << "worker " << w << ": " << s.tasks_run << (wavefront ? " tasks (" : " tiles (") << s.tasks_stolen << " stolen), "
+				<< "busy " << s.busy_seconds << "s, idle " << s.idle_seconds << "s\n";
+		}
+	}
+
+	void print_shading_stats() const {
+		for (const auto& type : get_shading_stats_by_type()) {
+			const auto& s = type.second;
+			std::clog << type.first << ": " << s.scatters << " scatters in " << s.seconds << "s, "
+				<< (s.seconds > 0 ? s.scatters / s.seconds / 1e6 : 0.0) << " Mscatters/s\n";
+		}
+	}
+
+	// rays counts every segment traced. primary is the record of r when it was already traced as part of a packet,
+	// without a material when it missed
+	Color3 ray_color(const Ray& r, const Hittable& world, RNG& rng, long long& rays, const HitRecord* primary = nullptr) const {
+		Ray ray = r;
+		Color3 throughput(1, 1, 1); // product of the attenuations along the path so far
+
+		for (int depth = 0; depth < max_depth; depth++) {
+			rays++;
+			if (depth == 0)
+				SRT_STAT(primary_rays);
+			else
+				SRT_STAT(secondary_rays);
+
+			HitRecord rec;
+			if (depth == 0 && primary)
+				rec = *primary;
+			bool hit_scene = (depth == 0 && primary) ? rec.mat != nullptr : world.hit(ray, Interval(0.001, infinity), rec);
+			if (!hit_scene) {
+				SRT_STAT_PATH(depth + 1);
+				return throughput * background(ray);
+			}
+			SRT_STAT(ray_hits);
 
-		HitRecord rec;
-		if (world.hit(r, Interval(0.001, infinity), rec)) {
 			Ray scattered;
 			Color3 atteunation;
-			if (rec.mat->scatter(r, rec, atteunation, scattered))
-				return atteunation * ray_color(scattered, depth - 1, world);
-			return Color3(0, 0, 0);
+			if (!scatter(ray, rec, atteunation, scattered, rng)) {
+				SRT_STAT_PATH(depth + 1);
+				return Color3(0, 0, 0);
+			}
+
+			throughput = throughput * atteunation;
+			ray = scattered;
+
+			if (!russian_roulette(throughput, depth, rng)) {
+				SRT_STAT_PATH(depth + 1);
+				return Color3(0, 0, 0);
+			}
 		}
+		SRT_STAT_PATH(max_depth);
+		return Color3(0, 0, 0);
+	}
+
+	bool scatter(const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered, RNG& rng) const {
+		return use_material_table
+			? materials.scatter(r, rec, atteunation, scattered, rng)
+			: rec.mat->scatter(r, rec, atteunation, scattered, rng);
+	}
+
+	// russian roulette: end dim paths early and weight the survivors up, so the expected color is unchanged.
+	// false when the path ends after this bounce
+	bool russian_roulette(Color3& throughput, int depth, RNG& rng) const {
+		if (russian_roulette_depth < 0 || depth + 1 < russian_roulette_depth)
+			return true;
+
+		auto survive = fmin(fmax(throughput.x(), fmax(throughput.y(), throughput.z())), 0.95);
+		if (random_double(rng) >= survive)
+			return false;
+		throughput /= survive;
+		return true;
+	}
+
+	Color3 background(const Ray& r) const {
 		Vec3 unit_direction = unit_vector(r.direction());
 		auto a = 0.5 * (unit_direction.y() + 1.0);
 		return (1.0 - a) * Color3(1.0, 1.0, 1.0) + a * Color3(0.5, 0.7, 1.0);
 	}
 
-	Ray get_ray(int i, int j) const {
+	Ray get_ray(int i, int j, RNG& rng) const {
 		auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
-		auto pixel_sample = pixel_center + pixel_sample_square();
+		auto pixel_sample = pixel_center + pixel_sample_square(rng);
 
-		auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+		auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample(rng);
 		auto ray_direction = pixel_sample - center;
-		auto ray_time = random_double();
+		auto ray_time = random_double(rng);
 
 		return Ray(center, ray_direction, ray_time);
 	}
 
-	Point3 defocus_disk_sample() const {
-		auto p = random_in_unit_disk();
+	Point3 defocus_disk_sample(RNG& rng) const {
+		auto p = random_in_unit_disk(rng);
 		return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
 	}
 
-	Vec3 pixel_sample_square() const {
-		auto px = -0.5 + random_double();
-		auto py = -0.5 + random_double();
+	Vec3 pixel_sample_square(RNG& rng) const {
+		auto px = -0.5 + random_double(rng);
+		auto py = -0.5 + random_double(rng);
 		return px * pixel_delta_u + py * pixel_delta_v;
 	}
 };
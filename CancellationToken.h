@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+
+/*
+	CancellationToken
+	- shared flag to stop a running render from another thread
+	- cancel() is sticky until reset(); render workers poll is_cancelled() between samples
+*/
+class CancellationToken
+{
+public:
+	CancellationToken() {}
+	CancellationToken(const CancellationToken&) = delete;
+	CancellationToken& operator=(const CancellationToken&) = delete;
+
+	void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+	void reset() { cancelled.store(false, std::memory_order_relaxed); }
+	bool is_cancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<bool> cancelled{ false };
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Color.h"
+#include "Framebuffer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+/*
+	PixelEstimate
+	- samples a pixel took during the current render, with the running mean and variance of their luminance (Welford)
+*/
+struct PixelEstimate
+{
+	int samples = 0;
+	double mean = 0;
+	double m2 = 0;
+	bool converged = false;
+};
+
+/*
+	Checkpoint
+	- binary snapshot of a render in progress: accumulation buffer, per pixel sample counts and adaptive sampling state
+	- sample streams are counter based (RNG::for_pixel_sample), so a pixel's sample count is also its RNG position
+	  and nothing else has to be stored to continue the exact same sequence
+	- layout: "SRTCKPT1", int32 width, int32 height, uint32 seed,
+	  then per pixel: double sum[3], int32 count, int32 samples, double mean, double m2, uint8 converged
+*/
+class Checkpoint
+{
+public:
+	// writes to a temporary file first, so a crash while writing leaves the previous checkpoint intact
+	static bool write(const std::string& path, unsigned int seed, const Framebuffer& framebuffer, const std::vector<PixelEstimate>& estimates) {
+		std::string file(magic, magic_size);
+		put(file, static_cast<int32_t>(framebuffer.width()));
+		put(file, static_cast<int32_t>(framebuffer.height()));
+		put(file, static_cast<uint32_t>(seed));
+
+		file.reserve(file.size() + framebuffer.pixel_count() * pixel_record_size);
+		for (size_t p = 0; p < framebuffer.pixel_count(); p++) {
+			const Color3& sum = framebuffer.color_sum(p);
+			const PixelEstimate& estimate = estimates[p];
+			for (int k = 0; k < 3; k++)
+				put(file, sum[k]);
+			put(file, static_cast<int32_t>(framebuffer.sample_count(p)));
+			put(file, static_cast<int32_t>(estimate.samples));
+			put(file, estimate.mean);
+			put(file, estimate.m2);
+			put(file, static_cast<uint8_t>(estimate.converged ? 1 : 0));
+		}
+
+		std::string temporary = path + ".tmp";
+		{
+			std::ofstream out(temporary, std::ios::binary);
+			if (out)
+				out.write(file.data(), static_cast<std::streamsize>(file.size()));
+			if (!out) {
+				std::cerr << "ERROR: Could not write checkpoint file '" << temporary << "'.\n";
+				return false;
+			}
+		}
+		// rename does not replace an existing file everywhere
+		if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+			std::remove(path.c_str());
+			if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+				std::cerr << "ERROR: Could not replace checkpoint file '" << path << "'.\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// leaves framebuffer and estimates untouched when the file is missing or malformed
+	static bool read(const std::string& path, unsigned int& seed, Framebuffer& framebuffer, std::vector<PixelEstimate>& estimates) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			std::cerr << "ERROR: Could not open checkpoint file '" << path << "'.\n";
+			return false;
+		}
+		std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+		size_t header_size = magic_size + 3 * sizeof(int32_t);
+		if (file.size() < header_size || file.compare(0, magic_size, magic, magic_size) != 0) {
+			std::cerr << "ERROR: '" << path << "' is not a checkpoint file.\n";
+			return false;
+		}
+
+		const char* at = file.data() + magic_size;
+		int32_t width = get<int32_t>(at);
+		int32_t height = get<int32_t>(at);
+		uint32_t file_seed = get<uint32_t>(at);
+		size_t pixels = (width > 0 && height > 0) ? static_cast<size_t>(width) * height : 0;
+		if (pixels == 0 || file.size() != header_size + pixels * pixel_record_size) {
+			std::cerr << "ERROR: Checkpoint file '" << path << "' is truncated or corrupt.\n";
+			return false;
+		}
+
+		Framebuffer loaded(width, height);
+		std::vector<PixelEstimate> loaded_estimates(pixels);
+		for (size_t p = 0; p < pixels; p++) {
+			double sum[3];
+			for (int k = 0; k < 3; k++)
+				sum[k] = get<double>(at);
+			int32_t count = get<int32_t>(at);
+			loaded.set_pixel(p, Color3(sum[0], sum[1], sum[2]), count);
+
+			PixelEstimate& estimate = loaded_estimates[p];
+			estimate.samples = get<int32_t>(at);
+			estimate.mean = get<double>(at);
+			estimate.m2 = get<double>(at);
+			estimate.converged = get<uint8_t>(at) != 0;
+		}
+
+		seed = file_seed;
+		framebuffer = std::move(loaded);
+		estimates = std::move(loaded_estimates);
+		return true;
+	}
+
+private:
+	static constexpr const char* magic = "SRTCKPT1";
+	static const size_t magic_size = 8;
+	static const size_t pixel_record_size = 3 * sizeof(double) + 2 * sizeof(int32_t) + 2 * sizeof(double) + sizeof(uint8_t);
+
+	template <typename T>
+	static void put(std::string& file, T value) {
+		file.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	static T get(const char*& at) {
+		T value;
+		std::memcpy(&value, at, sizeof(T));
+		at += sizeof(T);
+		return value;
+	}
+};
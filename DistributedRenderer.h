@@ -0,0 +1,380 @@
+#pragma once
+
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "Hittable.h"
+#include "TileScheduler.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SRT_DISTRIBUTED_POSIX 1
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/*
+	DistributedRenderer
+	- a coordinator hands the tiles of a frame to worker processes and merges the pixels they send back
+	- workers are forked children connected over socket pairs, or processes on other hosts connected over TCP
+	- every worker builds the same scene and camera. sample streams are counter based, so the merged image
+	  is identical to a single process render()
+	- protocol, all fields in host byte order (hosts must share endianness):
+	  worker -> coordinator  hello:  "SRTDIST1", int32 width, int32 height, uint32 seed, int32 samples_per_pixel
+	  coordinator -> worker  job:    int32 tile index (-1 = no more work), int32 x0, y0, x1, y1
+	  worker -> coordinator  result: int32 tile index, then per pixel of the tile, row by row: double sum[3], int32 count
+	- a tile whose worker disconnects is handed to another worker
+*/
+class DistributedRenderer
+{
+public:
+	// forks worker_count children on this host (0 = one per hardware thread) and renders with them
+	static bool render_local(Camera& cam, const Hittable& world, int worker_count) {
+#if defined(SRT_DISTRIBUTED_POSIX)
+		worker_count = TileScheduler::resolve_thread_count(worker_count);
+		cam.begin_frame(); // the children inherit the initialized camera
+
+		std::vector<int> connections;
+		std::vector<pid_t> children;
+		for (int w = 0; w < worker_count; w++) {
+			int ends[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) {
+				std::cerr << "ERROR: Could not create a socket pair for worker " << w << ".\n";
+				break;
+			}
+
+			pid_t pid = fork();
+			if (pid == 0) {
+				close(ends[0]);
+				for (int connection : connections)
+					close(connection);
+				bool ok = work_on(cam, world, ends[1]);
+				close(ends[1]);
+				_exit(ok ? 0 : 1);
+			}
+
+			close(ends[1]);
+			if (pid < 0) {
+				std::cerr << "ERROR: Could not start worker process " << w << ".\n";
+				close(ends[0]);
+				break;
+			}
+			connections.push_back(ends[0]);
+			children.push_back(pid);
+		}
+
+		bool ok = coordinate(cam, connections);
+		for (pid_t child : children)
+			waitpid(child, nullptr, 0);
+		return ok;
+#else
+		(void)cam; (void)world; (void)worker_count;
+		std::cerr << "ERROR: Distributed rendering needs a POSIX system.\n";
+		return false;
+#endif
+	}
+
+	// waits until worker_count workers have connected to port, then renders with them
+	static bool serve(Camera& cam, int port, int worker_count) {
+#if defined(SRT_DISTRIBUTED_POSIX)
+		int listener = socket(AF_INET, SOCK_STREAM, 0);
+		if (listener < 0) {
+			std::cerr << "ERROR: Could not create the coordinator socket.\n";
+			return false;
+		}
+		int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(static_cast<uint16_t>(port));
+		if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, worker_count) != 0) {
+			std::cerr << "ERROR: Could not listen on port " << port << ".\n";
+			close(listener);
+			return false;
+		}
+
+		cam.begin_frame();
+		std::vector<int> connections;
+		std::clog << "\rWaiting for workers: 0/" << worker_count << ' ' << std::flush;
+		while (static_cast<int>(connections.size()) < worker_count) {
+			int connection = accept(listener, nullptr, nullptr);
+			if (connection < 0) {
+				// a signal or a client that gave up before we got to it, anything else will not get better
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				std::cerr << "\nERROR: Could not accept a worker on port " << port << ": " << std::strerror(errno) << ".\n";
+				for (int c : connections)
+					close(c);
+				close(listener);
+				return false;
+			}
+			connections.push_back(connection);
+			std::clog << "\rWaiting for workers: " << connections.size() << '/' << worker_count << ' ' << std::flush;
+		}
+		close(listener);
+		std::clog << '\n';
+
+		return coordinate(cam, connections);
+#else
+		(void)cam; (void)port; (void)worker_count;
+		std::cerr << "ERROR: Distributed rendering needs a POSIX system.\n";
+		return false;
+#endif
+	}
+
+	// connects to the coordinator at host:port and renders tiles until it runs out of them
+	static bool work(Camera& cam, const Hittable& world, const std::string& host, int port) {
+#if defined(SRT_DISTRIBUTED_POSIX)
+		addrinfo hints;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* addresses = nullptr;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+			std::cerr << "ERROR: Could not resolve coordinator '" << host << "'.\n";
+			return false;
+		}
+
+		int connection = -1;
+		for (addrinfo* a = addresses; a && connection < 0; a = a->ai_next) {
+			connection = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+			if (connection >= 0 && connect(connection, a->ai_addr, a->ai_addrlen) != 0) {
+				close(connection);
+				connection = -1;
+			}
+		}
+		freeaddrinfo(addresses);
+		if (connection < 0) {
+			std::cerr << "ERROR: Could not connect to coordinator " << host << ':' << port << ".\n";
+			return false;
+		}
+
+		cam.begin_frame();
+		bool ok = work_on(cam, world, connection);
+		close(connection);
+		return ok;
+#else
+		(void)cam; (void)world; (void)host; (void)port;
+		std::cerr << "ERROR: Distributed rendering needs a POSIX system.\n";
+		return false;
+#endif
+	}
+
+private:
+#if defined(SRT_DISTRIBUTED_POSIX)
+	struct Hello {
+		char magic[8];
+		int32_t width;
+		int32_t height;
+		uint32_t seed;
+		int32_t samples_per_pixel;
+	};
+
+	struct Job {
+		int32_t index; // -1 = no more work
+		int32_t x0, y0;
+		int32_t x1, y1;
+	};
+
+	static const size_t pixel_record_size = 3 * sizeof(double) + sizeof(int32_t);
+
+	static Hello make_hello(const Camera& cam) {
+		Hello hello;
+		std::memcpy(hello.magic, "SRTDIST1", sizeof(hello.magic));
+		hello.width = cam.get_framebuffer().width();
+		hello.height = cam.get_framebuffer().height();
+		hello.seed = cam.seed;
+		hello.samples_per_pixel = cam.samples_per_pixel;
+		return hello;
+	}
+
+	static bool send_all(int connection, const void* data, size_t size) {
+		const char* at = static_cast<const char*>(data);
+		while (size > 0) {
+#if defined(MSG_NOSIGNAL)
+			ssize_t sent = send(connection, at, size, MSG_NOSIGNAL);
+#else
+			ssize_t sent = send(connection, at, size, 0);
+#endif
+			if (sent <= 0) return false;
+			at += sent;
+			size -= static_cast<size_t>(sent);
+		}
+		return true;
+	}
+
+	static bool receive_all(int connection, void* data, size_t size) {
+		char* at = static_cast<char*>(data);
+		while (size > 0) {
+			ssize_t received = recv(connection, at, size, 0);
+			if (received <= 0) return false;
+			at += received;
+			size -= static_cast<size_t>(received);
+		}
+		return true;
+	}
+
+	static bool send_job(int connection, const Tile& tile) {
+		Job job = { tile.index, tile.x0, tile.y0, tile.x1, tile.y1 };
+		return send_all(connection, &job, sizeof(job));
+	}
+
+	// worker side: answer every job with the pixels of its tile. cam must have begun its frame
+	static bool work_on(Camera& cam, const Hittable& world, int connection) {
+		Hello hello = make_hello(cam);
+		if (!send_all(connection, &hello, sizeof(hello)))
+			return false;
+
+		const Framebuffer& framebuffer = cam.get_framebuffer();
+		std::string result;
+		while (true) {
+			Job job;
+			if (!receive_all(connection, &job, sizeof(job)))
+				return false;
+			if (job.index < 0)
+				return true;
+
+			Tile tile = { job.index, job.x0, job.y0, job.x1, job.y1 };
+			cam.render_region(world, tile);
+
+			result.assign(reinterpret_cast<const char*>(&job.index), sizeof(job.index));
+			for (int j = tile.y0; j < tile.y1; j++) {
+				for (int i = tile.x0; i < tile.x1; i++) {
+					size_t pixel = framebuffer.index(i, j);
+					const Color3& sum = framebuffer.color_sum(pixel);
+					int32_t count = framebuffer.sample_count(pixel);
+					result.append(reinterpret_cast<const char*>(sum.e), 3 * sizeof(double));
+					result.append(reinterpret_cast<const char*>(&count), sizeof(count));
+				}
+			}
+			if (!send_all(connection, result.data(), result.size()))
+				return false;
+		}
+	}
+
+	// reads one result and merges it into cam. false when the worker is gone or sent garbage
+	static bool merge_result(Camera& cam, int connection, const std::vector<Tile>& tiles, int expected_tile) {
+		int32_t index;
+		if (!receive_all(connection, &index, sizeof(index)) || index != expected_tile)
+			return false;
+
+		const Tile& tile = tiles[index];
+		size_t pixels = static_cast<size_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+		std::vector<char> data(pixels * pixel_record_size);
+		if (!receive_all(connection, data.data(), data.size()))
+			return false;
+
+		const char* at = data.data();
+		for (int j = tile.y0; j < tile.y1; j++) {
+			for (int i = tile.x0; i < tile.x1; i++) {
+				double sum[3];
+				int32_t count;
+				std::memcpy(sum, at, sizeof(sum));
+				std::memcpy(&count, at + sizeof(sum), sizeof(count));
+				at += pixel_record_size;
+				cam.merge_pixel(cam.get_framebuffer().index(i, j), Color3(sum[0], sum[1], sum[2]), count);
+			}
+		}
+		return true;
+	}
+
+	// coordinator side: one job in flight per worker until every tile is merged. closes the connections
+	static bool coordinate(Camera& cam, std::vector<int> connections) {
+		const Framebuffer& framebuffer = cam.get_framebuffer();
+		Hello expected = make_hello(cam);
+		for (auto& connection : connections) {
+			Hello hello;
+			if (!receive_all(connection, &hello, sizeof(hello)) || std::memcmp(&hello, &expected, sizeof(hello)) != 0) {
+				std::cerr << "ERROR: A worker did not match the coordinator's image size, seed or sample count.\n";
+				close(connection);
+				connection = -1;
+			}
+		}
+
+		TileScheduler scheduler(framebuffer.width(), framebuffer.height(), cam.tile_size);
+		const auto& tiles = scheduler.get_tiles();
+		std::deque<int> queued;
+		for (const auto& tile : tiles)
+			queued.push_back(tile.index);
+		std::vector<int> in_flight(connections.size(), -1);
+		size_t merged = 0;
+
+		auto drop = [&](size_t w) {
+			std::cerr << "ERROR: Lost worker " << w << ", its tile is handed to another worker.\n";
+			if (in_flight[w] >= 0)
+				queued.push_front(in_flight[w]);
+			in_flight[w] = -1;
+			close(connections[w]);
+			connections[w] = -1;
+		};
+
+		while (merged < tiles.size()) {
+			// keep every idle worker busy
+			for (size_t w = 0; w < connections.size() && !queued.empty(); w++) {
+				if (connections[w] < 0 || in_flight[w] >= 0) continue;
+				in_flight[w] = queued.front();
+				queued.pop_front();
+				if (!send_job(connections[w], tiles[in_flight[w]]))
+					drop(w);
+			}
+
+			std::vector<pollfd> busy;
+			std::vector<size_t> busy_worker;
+			for (size_t w = 0; w < connections.size(); w++) {
+				if (connections[w] < 0 || in_flight[w] < 0) continue;
+				pollfd entry;
+				entry.fd = connections[w];
+				entry.events = POLLIN;
+				entry.revents = 0;
+				busy.push_back(entry);
+				busy_worker.push_back(w);
+			}
+			// idle workers that are still connected always get a job above, so nobody is left
+			if (busy.empty()) {
+				std::cerr << "ERROR: No workers left, " << tiles.size() - merged << " tiles were not rendered.\n";
+				break;
+			}
+
+			if (poll(busy.data(), static_cast<nfds_t>(busy.size()), -1) < 0)
+				continue;
+
+			for (size_t k = 0; k < busy.size(); k++) {
+				if (!busy[k].revents) continue;
+				size_t w = busy_worker[k];
+				if (!merge_result(cam, connections[w], tiles, in_flight[w])) {
+					drop(w);
+					continue;
+				}
+				in_flight[w] = -1;
+				merged++;
+				std::clog << "\rTiles remaining: " << tiles.size() - merged << ' ' << std::flush;
+			}
+		}
+
+		Job done = { -1, 0, 0, 0, 0 };
+		for (int connection : connections) {
+			if (connection < 0) continue;
+			send_all(connection, &done, sizeof(done));
+			close(connection);
+		}
+
+		cam.end_frame();
+		return merged == tiles.size();
+	}
+#endif
+};
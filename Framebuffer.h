@@ -0,0 +1,200 @@
+#pragma once
+
+#include "utilities.h"
+#include "Color.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+enum class ImageFormat
+{
+	PPM, // binary P6, gamma corrected 8 bit
+	PFM, // portable float map, linear 32 bit float
+	Raw, // linear 32 bit float dump behind a small header
+};
+
+/*
+	Framebuffer
+	- linear HDR accumulation buffer: per pixel sum of samples and sample count, row major from the top-left pixel
+	- tone mapping runs as a separate pass over the whole frame, so more samples can be added at any time
+	- writers build the whole file in memory and emit it with one write
+*/
+class Framebuffer
+{
+public:
+	Framebuffer() {}
+	Framebuffer(int width, int height) { resize(width, height); }
+
+	// clears every pixel
+	void resize(int width, int height) {
+		image_width = width;
+		image_height = height;
+		color_sums.assign(static_cast<size_t>(width) * height, Color3(0, 0, 0));
+		sample_counts.assign(color_sums.size(), 0);
+	}
+
+	int width() const { return image_width; }
+	int height() const { return image_height; }
+	size_t pixel_count() const { return color_sums.size(); }
+	size_t index(int i, int j) const { return static_cast<size_t>(j) * image_width + i; }
+
+	void add_samples(size_t pixel, const Color3& color_sum, int samples) {
+		color_sums[pixel] += color_sum;
+		sample_counts[pixel] += samples;
+	}
+
+	// overwrites a pixel, used when its samples were summed elsewhere or restored from a file
+	void set_pixel(size_t pixel, const Color3& color_sum, int samples) {
+		color_sums[pixel] = color_sum;
+		sample_counts[pixel] = samples;
+	}
+
+	const Color3& color_sum(size_t pixel) const { return color_sums[pixel]; }
+	int sample_count(size_t pixel) const { return sample_counts[pixel]; }
+
+	// linear average of the samples of a pixel, black when it has none
+	Color3 average(size_t pixel) const {
+		int n = sample_counts[pixel];
+		return (n > 0) ? color_sums[pixel] / n : Color3(0, 0, 0);
+	}
+
+	// picks the writer from the extension of path: .pfm, .raw, anything else is written as a binary ppm
+	bool write(const std::string& path) const {
+		return write(path, format_from_path(path));
+	}
+
+	bool write(const std::string& path, ImageFormat format) const {
+		switch (format) {
+		case ImageFormat::PFM: return write_pfm(path);
+		case ImageFormat::Raw: return write_raw(path);
+		case ImageFormat::PPM:
+		default: return write_ppm(path);
+		}
+	}
+
+	// average, gamma correct, clamp and quantize every pixel into 8 bit RGB.
+	// branch free over flat arrays, so the compiler can vectorize it
+	void tone_map(unsigned char* rgb) const {
+		for (size_t p = 0; p < pixel_count(); p++) {
+			int n = sample_counts[p];
+			double scale = (n > 0) ? 1.0 / n : 0.0;
+			const double* sum = color_sums[p].e;
+			for (int k = 0; k < 3; k++) {
+				double v = linear_to_gamma(sum[k] * scale);
+				v = std::min(std::max(v, 0.0), 0.999);
+				rgb[3 * p + k] = static_cast<unsigned char>(255.999 * v);
+			}
+		}
+	}
+
+	bool write_ppm(const std::string& path) const {
+		std::string file = "P6\n" + std::to_string(image_width) + " " + std::to_string(image_height) + "\n255\n";
+		size_t header_size = file.size();
+		file.resize(header_size + 3 * pixel_count());
+
+		tone_map(reinterpret_cast<unsigned char*>(&file[header_size]));
+
+		return write_file(path, file);
+	}
+
+	// rows are stored bottom to top, a negative scale marks little endian data
+	bool write_pfm(const std::string& path) const {
+		std::string file = "PF\n" + std::to_string(image_width) + " " + std::to_string(image_height) + "\n"
+			+ (is_little_endian() ? "-1.0\n" : "1.0\n");
+		size_t header_size = file.size();
+		file.resize(header_size + 3 * sizeof(float) * pixel_count());
+
+		char* out = &file[header_size];
+		for (int j = image_height - 1; j >= 0; j--)
+			for (int i = 0; i < image_width; i++)
+				out = put_color(out, average(index(i, j)));
+
+		return write_file(path, file);
+	}
+
+	// "SRTRAW01", int32 width, int32 height, then width * height linear float RGB triples, top row first
+	bool write_raw(const std::string& path) const {
+		std::string file("SRTRAW01", 8);
+		int32_t size[2] = { image_width, image_height };
+		file.append(reinterpret_cast<const char*>(size), sizeof(size));
+		size_t header_size = file.size();
+		file.resize(header_size + 3 * sizeof(float) * pixel_count());
+
+		char* out = &file[header_size];
+		for (size_t p = 0; p < pixel_count(); p++)
+			out = put_color(out, average(p));
+
+		return write_file(path, file);
+	}
+
+	// binary grayscale map of the sample counts, white is the highest count in the frame
+	bool write_sample_map(const std::string& path) const {
+		std::string file = "P5\n" + std::to_string(image_width) + " " + std::to_string(image_height) + "\n255\n";
+		size_t header_size = file.size();
+		file.resize(header_size + pixel_count());
+
+		int max_samples = 1;
+		for (int count : sample_counts)
+			max_samples = std::max(max_samples, count);
+		for (size_t p = 0; p < pixel_count(); p++) {
+			int level = (255 * sample_counts[p]) / max_samples;
+			file[header_size + p] = static_cast<char>(level > 255 ? 255 : level);
+		}
+
+		return write_file(path, file);
+	}
+
+	static ImageFormat format_from_path(const std::string& path) {
+		if (has_extension(path, ".pfm")) return ImageFormat::PFM;
+		if (has_extension(path, ".raw")) return ImageFormat::Raw;
+		return ImageFormat::PPM;
+	}
+
+	// "out/frame.ppm" + "_samples", ".pgm" -> "out/frame_samples.pgm"
+	static std::string sibling_path(const std::string& path, const std::string& suffix, const std::string& extension) {
+		auto slash = path.find_last_of("/\\");
+		auto dot = path.find_last_of('.');
+		auto stem_end = (dot != std::string::npos && (slash == std::string::npos || dot > slash)) ? dot : path.size();
+		return path.substr(0, stem_end) + suffix + extension;
+	}
+
+private:
+	int image_width = 0;
+	int image_height = 0;
+	std::vector<Color3> color_sums;
+	std::vector<int> sample_counts;
+
+	static bool has_extension(const std::string& path, const char* extension) {
+		size_t n = std::strlen(extension);
+		return path.size() >= n && path.compare(path.size() - n, n, extension) == 0;
+	}
+
+	static bool is_little_endian() {
+		uint16_t probe = 1;
+		unsigned char first;
+		std::memcpy(&first, &probe, 1);
+		return first == 1;
+	}
+
+	static char* put_color(char* out, const Color3& c) {
+		float rgb[3] = { static_cast<float>(c.x()), static_cast<float>(c.y()), static_cast<float>(c.z()) };
+		std::memcpy(out, rgb, sizeof(rgb));
+		return out + sizeof(rgb);
+	}
+
+	static bool write_file(const std::string& path, const std::string& contents) {
+		std::ofstream out(path, std::ios::binary);
+		if (out)
+			out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+		if (!out) {
+			std::cerr << "ERROR: Could not write image file '" << path << "'.\n";
+			return false;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Color.h"
+#include "Framebuffer.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+enum class CostMetric
+{
+	Off,
+	Time,       // wall clock seconds spent in the pixel
+	NodeVisits, // BVH nodes visited for the pixel, needs a build with SRT_ENABLE_STATS
+};
+
+/*
+	Heatmap
+	- turns a per pixel cost into a false color image: black (cheap), blue, red, yellow, white (expensive)
+	- colors are scaled to the 99th percentile, so a few outliers do not wash out the rest of the frame
+*/
+class Heatmap
+{
+public:
+	// t in [0, 1]
+	static Color3 false_color(double t) {
+		static const Color3 stops[] = {
+			Color3(0, 0, 0), Color3(0.1, 0.1, 0.8), Color3(0.9, 0.1, 0.2), Color3(1.0, 0.9, 0.1), Color3(1, 1, 1)
+		};
+		const int segments = 4;
+		t = std::min(std::max(t, 0.0), 1.0) * segments;
+		int k = std::min(static_cast<int>(t), segments - 1);
+		double f = t - k;
+		return (1 - f) * stops[k] + f * stops[k + 1];
+	}
+
+	// row major from the top-left pixel, written by Framebuffer so the format follows the extension of path
+	static bool write(const std::string& path, int width, int height, const std::vector<double>& costs) {
+		std::vector<double> sorted(costs);
+		size_t at = (sorted.size() * 99) / 100;
+		at = std::min(at, sorted.empty() ? 0 : sorted.size() - 1);
+		std::nth_element(sorted.begin(), sorted.begin() + at, sorted.end());
+		double scale = (!sorted.empty() && sorted[at] > 0) ? 1.0 / sorted[at] : 0.0;
+
+		Framebuffer image(width, height);
+		for (size_t p = 0; p < costs.size(); p++) {
+			// the stops are display colors, squared so the gamma of the writer gives them back exactly
+			Color3 c = false_color(costs[p] * scale);
+			image.set_pixel(p, c * c, 1);
+		}
+		return image.write(path);
+	}
+};
@@ -1,15 +1,21 @@
 #pragma once
 #include "utilities.h"
 #include "AABB.h"
+#include "RayPacket.h"
+
+#include <cstdint>
+#include <vector>
 
 class Material;
+class MaterialTable;
 
 class HitRecord
 {
 public :
 	Point3 p;
 	Vec3 normal;
-	shared_ptr<Material> mat;
+	const Material* mat = nullptr; // owned by the primitive that was hit, copying a record never touches a refcount
+	uint32_t material_id = 0; // index of mat in the MaterialTable built over the world
 	double t; // ray hit coefficient
 	double u; // texture coordinate - u
 	double v; // texture coordinate - v
@@ -27,5 +33,23 @@ public:
 	virtual ~Hittable() = default;
 	virtual bool hit(const Ray& ray, Interval ray_t, HitRecord& rec) const = 0;
 	virtual AABB bounding_box() const = 0;
+
+	// closest hits of a whole packet: rays[k] is searched within ray_ts[k], and for every ray whose bit is set
+	// in the returned mask recs[k] is filled in and ray_ts[k].max lowered to its t.
+	// the default traces the rays one by one, accelerators override it to share the traversal
+	virtual uint64_t hit_packet(const RayPacket& packet, Interval* ray_ts, HitRecord* recs) const {
+		uint64_t hits = 0;
+		for (int k = 0; k < packet.size; k++) {
+			if (hit(packet.rays[k], ray_ts[k], recs[k])) {
+				hits |= 1ULL << k;
+				ray_ts[k].max = recs[k].t;
+			}
+		}
+		return hits;
+	}
+
+	// adds the materials used below this object to table and keeps the ids it hands out for HitRecord::material_id.
+	// the ids are a cache owned by MaterialTable::build: every table built over the same world hands out the same ones
+	virtual void bind_materials(MaterialTable&) const {}
 };
 
@@ -41,9 +41,32 @@ public:
 		return hit_anything;
 	}
 
+	// every object takes the whole packet, so an accelerator in the list still walks it together.
+	// a later object only wins a ray with a strictly closer hit, as in hit()
+	// every object only reports hits closer than what each ray found so far, as in hit()
+	uint64_t hit_packet(const RayPacket& packet, Interval* ray_ts, HitRecord* recs) const override {
+		HitRecord temp_recs[RayPacket::max_size];
+		uint64_t hits = 0;
+
+		for (const auto& object : objects) {
+			uint64_t object_hits = object->hit_packet(packet, ray_ts, temp_recs);
+			for (int k = 0; k < packet.size; k++)
+				if ((object_hits >> k) & 1)
+					recs[k] = temp_recs[k];
+			hits |= object_hits;
+		}
+
+		return hits;
+	}
+
 	// bounding box getter
 	AABB bounding_box() const override { return bbox; }
 
+	void bind_materials(MaterialTable& table) const override {
+		for (const auto& object : objects)
+			object->bind_materials(table);
+	}
+
 private:
 	AABB bbox;
 };
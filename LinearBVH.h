@@ -0,0 +1,561 @@
+#pragma once
+
+#include "utilities.h"
+
+#include "Hittable.h"
+#include "HittableList.h"
+#include "RenderStats.h"
+#include "Sphere.h"
+#include "SphereSet.h"
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+	LinearBVHNode
+	- 32 byte node of a flattened BVH
+	- the first child of an interior node is stored right after it, offset points at the second child
+*/
+struct LinearBVHNode
+{
+	float bounds_min[3];
+	float bounds_max[3];
+	int32_t offset;           // leaf: first primitive index, interior: index of the second child
+	uint16_t primitive_count; // 0 for interior nodes
+	uint8_t axis;             // split axis of interior nodes
+	uint8_t pad;
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must stay 32 bytes");
+
+enum class BVHSplitMethod
+{
+	Median, // half of the primitives on each side of the longest centroid axis
+	SAH,    // binned surface area heuristic
+};
+
+struct BVHBuildOptions
+{
+	BVHSplitMethod split_method = BVHSplitMethod::Median;
+	int max_leaf_size = 4;           // leaf-size threshold: larger ranges are always split
+	int sah_bins = 16;               // buckets per axis evaluated by the SAH builder
+	double traversal_cost = 1.0;     // cost of visiting an interior node
+	double intersection_cost = 1.0;  // cost of testing one primitive
+	int build_threads = 0;           // 0 = one builder per hardware thread
+	size_t parallel_threshold = 4096; // subtrees over at least this many primitives are built as their own task
+	bool pack_spheres = false;       // leaves of two or more spheres become one SphereSet, tested 4 at a time
+};
+
+/*
+	LinearBVH
+	- BVH stored in one contiguous array of nodes, depth first
+	- leaves reference a range of the primitive array instead of owning pointers
+	- traversed iteratively with an explicit stack
+	- built by partitioning one primitive array in place, large subtrees in parallel
+*/
+class LinearBVH : public Hittable
+{
+public:
+	LinearBVH(const HittableList& list, const BVHBuildOptions& build_options = BVHBuildOptions())
+		: LinearBVH(list.objects, build_options) {}
+	LinearBVH(const std::vector<shared_ptr<Hittable>>& src_objects, const BVHBuildOptions& build_options = BVHBuildOptions())
+		: options(build_options)
+	{
+		options.max_leaf_size = std::max(1, std::min(options.max_leaf_size, 0xFFFF));
+		options.sah_bins = std::max(2, std::min(options.sah_bins, static_cast<int>(max_sah_bins)));
+
+		if (src_objects.empty()) return;
+
+		size_t count = src_objects.size();
+		WorkStealingScheduler scheduler(options.build_threads);
+		const size_t grain = 16384;
+
+		std::vector<BuildPrimitive> build(count);
+		scheduler.parallel_for(count, grain, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				build[i].bbox = src_objects[i]->bounding_box();
+				build[i].centroid = centroid_of(build[i].bbox);
+				build[i].index = static_cast<int>(i);
+			}
+		});
+
+		// partitions build[] in place; large subtrees are handed to other workers as they appear
+		BuildNode root;
+		scheduler.run({ [&]() { build_recursive(build, root, 0, count, 0); } });
+
+		// every leaf owns a contiguous range of build[], so it maps straight onto the primitive array
+		primitives.resize(count);
+		scheduler.parallel_for(count, grain, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				primitives[i] = src_objects[build[i].index];
+		});
+
+		nodes.reserve(2 * count);
+		flatten(root);
+		if (options.pack_spheres)
+			pack_sphere_leaves();
+
+		bbox = to_aabb(nodes[0]);
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+		if (nodes.empty())
+			return false;
+
+		int stack[max_stack_depth];
+		int stack_size = 0;
+		int current = 0;
+		bool hit_anything = false;
+
+		while (true) {
+			const auto& node = nodes[current];
+			SRT_STAT(bvh_nodes_visited);
+			SRT_STAT(aabb_tests);
+			if (node_hit(node, r, ray_t)) {
+				if (node.primitive_count > 0) {
+					for (int k = 0; k < node.primitive_count; k++) {
+						if (primitives[node.offset + k]->hit(r, ray_t, rec)) {
+							hit_anything = true;
+							ray_t.max = rec.t;
+						}
+					}
+					if (stack_size == 0) break;
+					current = stack[--stack_size];
+				}
+				else {
+					// visit the child closer to the ray origin first, so the far one is culled more often
+					if (r.sign(node.axis)) {
+						stack[stack_size++] = current + 1;
+						current = node.offset;
+					}
+					else {
+						stack[stack_size++] = node.offset;
+						current = current + 1;
+					}
+				}
+			}
+			else {
+				if (stack_size == 0) break;
+				current = stack[--stack_size];
+			}
+		}
+
+		return hit_anything;
+	}
+
+	// walks the tree once for the whole packet. a node is skipped outright when the frustum around the packet
+	// misses it, otherwise only the rays that were still in the parent are tested against it.
+	// every ray visits its nodes in the same order as in hit(), so it ends with the same record
+	uint64_t hit_packet(const RayPacket& packet, Interval* ray_ts, HitRecord* recs) const override {
+		if (nodes.empty() || packet.size == 0)
+			return 0;
+
+		PacketFrustum frustum;
+		if (!make_frustum(packet, frustum))
+			return Hittable::hit_packet(packet, ray_ts, recs);
+
+		double t_min = ray_ts[0].min;
+		for (int k = 1; k < packet.size; k++)
+			t_min = std::min(t_min, ray_ts[k].min);
+
+		PacketStackEntry stack[max_stack_depth];
+		int stack_size = 0;
+		int current = 0;
+		uint64_t mask = packet.all();
+		uint64_t hits = 0;
+
+		while (true) {
+			const auto& node = nodes[current];
+			uint64_t active = 0;
+
+			// the frustum test needs the furthest any ray still reaches
+			double t_max = t_min;
+			for (int k = 0; k < packet.size; k++)
+				if ((mask >> k) & 1)
+					t_max = std::max(t_max, ray_ts[k].max);
+
+			if (frustum_hit(node, frustum, t_min, t_max)) {
+				for (int k = 0; k < packet.size; k++) {
+					if (!((mask >> k) & 1))
+						continue;
+					SRT_STAT(bvh_nodes_visited);
+					SRT_STAT(aabb_tests);
+					if (node_hit(node, packet.rays[k], ray_ts[k]))
+						active |= 1ULL << k;
+				}
+			}
+
+			if (active != 0 && node.primitive_count == 0) {
+				// all rays share their direction signs, so they agree on the closer child
+				int near_child = frustum.sign[node.axis] ? node.offset : current + 1;
+				int far_child = frustum.sign[node.axis] ? current + 1 : node.offset;
+				stack[stack_size++] = PacketStackEntry{ far_child, active };
+				current = near_child;
+				mask = active;
+				continue;
+			}
+
+			for (int p = 0; active != 0 && p < node.primitive_count; p++) {
+				for (int k = 0; k < packet.size; k++) {
+					if (((active >> k) & 1) && primitives[node.offset + p]->hit(packet.rays[k], ray_ts[k], recs[k])) {
+						hits |= 1ULL << k;
+						ray_ts[k].max = recs[k].t;
+					}
+				}
+			}
+
+			if (stack_size == 0) break;
+			stack_size--;
+			current = stack[stack_size].node;
+			mask = stack[stack_size].mask;
+		}
+
+		return hits;
+	}
+
+	AABB bounding_box() const override { return bbox; }
+
+	void bind_materials(MaterialTable& table) const override {
+		for (const auto& primitive : primitives)
+			primitive->bind_materials(table);
+	}
+
+	size_t node_count() const { return nodes.size(); }
+	const BVHBuildOptions& get_build_options() const { return options; }
+
+	// expected cost of a random ray through the tree, with the cost constants of the build options
+	double sah_cost() const {
+		if (nodes.empty())
+			return 0;
+
+		double root_area = to_aabb(nodes[0]).surface_area();
+		if (root_area <= 0)
+			root_area = 1;
+
+		double cost = 0;
+		for (const auto& node : nodes) {
+			double probability = to_aabb(node).surface_area() / root_area;
+			if (node.primitive_count > 0)
+				cost += probability * options.intersection_cost * node.primitive_count;
+			else
+				cost += probability * options.traversal_cost;
+		}
+		return cost;
+	}
+
+	const std::vector<LinearBVHNode>& get_nodes() const { return nodes; }
+	const std::vector<shared_ptr<Hittable>>& get_primitives() const { return primitives; }
+
+	static const int max_stack_depth = 64;
+	static const int max_sah_bins = 64;
+
+private:
+	struct BuildPrimitive {
+		AABB bbox;
+		Point3 centroid;
+		int index;
+	};
+
+	// intermediate tree, flattened into nodes[] once the build is done
+	struct BuildNode {
+		AABB bbox;
+		std::unique_ptr<BuildNode> children[2]; // none for leaves
+		int axis = 0;
+		size_t start = 0;
+		size_t count = 0;
+	};
+
+	std::vector<LinearBVHNode> nodes;
+	std::vector<shared_ptr<Hittable>> primitives; // ordered so that every leaf owns a contiguous range
+	AABB bbox;
+	BVHBuildOptions options;
+
+	// builds node over build[start, end), reordering that range so every leaf ends up contiguous
+	void build_recursive(std::vector<BuildPrimitive>& build, BuildNode& node, size_t start, size_t end, int depth) const {
+		AABB bounds;
+		AABB centroid_bounds;
+		for (size_t i = start; i < end; i++) {
+			bounds = AABB(bounds, build[i].bbox);
+			centroid_bounds = AABB(centroid_bounds, AABB(build[i].centroid, build[i].centroid));
+		}
+
+		node.bbox = bounds;
+		node.start = start;
+		node.count = end - start;
+
+		size_t span = end - start;
+		int axis = longest_axis(centroid_bounds);
+		bool degenerate = centroid_bounds.axis(axis).size() <= 0;
+		bool fits_leaf = span <= static_cast<size_t>(options.max_leaf_size);
+
+		// traversal pushes one stack entry per level, so the depth is capped by the stack size
+		if (span == 1 || (degenerate && span <= 0xFFFF) || depth >= max_stack_depth - 1
+			|| (fits_leaf && options.split_method == BVHSplitMethod::Median))
+			return;
+
+		size_t mid = start;
+		if (options.split_method == BVHSplitMethod::SAH && !degenerate) {
+			SplitResult result = sah_split(build, start, end, bounds, centroid_bounds, fits_leaf, axis, mid);
+			if (result == SplitResult::Leaf)
+				return;
+			if (result == SplitResult::Fallback)
+				mid = start;
+		}
+
+		if (mid == start) {
+			// median split along the axis where the centroids are spread the most
+			mid = start + span / 2;
+			std::nth_element(build.begin() + start, build.begin() + mid, build.begin() + end,
+				[axis](const BuildPrimitive& a, const BuildPrimitive& b) { return a.centroid[axis] < b.centroid[axis]; });
+		}
+
+		node.axis = axis;
+		node.children[0].reset(new BuildNode());
+		node.children[1].reset(new BuildNode());
+
+		// the subtrees work on disjoint ranges, so a large one can be built by another worker
+		BuildNode* right = node.children[1].get();
+		if (end - mid >= options.parallel_threshold)
+			WorkStealingScheduler::spawn([this, &build, right, mid, end, depth]() { build_recursive(build, *right, mid, end, depth + 1); });
+		else
+			build_recursive(build, *right, mid, end, depth + 1);
+
+		build_recursive(build, *node.children[0], start, mid, depth + 1);
+	}
+
+	// appends node and its subtree depth first, returns its index
+	int flatten(const BuildNode& node) {
+		int node_index = static_cast<int>(nodes.size());
+		nodes.push_back(LinearBVHNode());
+		set_bounds(nodes[node_index], node.bbox);
+
+		if (!node.children[0]) {
+			nodes[node_index].offset = static_cast<int32_t>(node.start);
+			nodes[node_index].primitive_count = static_cast<uint16_t>(std::min<size_t>(node.count, 0xFFFF));
+			nodes[node_index].axis = 0;
+			return node_index;
+		}
+
+		flatten(*node.children[0]);
+		int second_child = flatten(*node.children[1]);
+
+		nodes[node_index].offset = second_child;
+		nodes[node_index].primitive_count = 0;
+		nodes[node_index].axis = static_cast<uint8_t>(node.axis);
+		return node_index;
+	}
+
+	// replaces the primitives of every leaf made only of spheres by one SphereSet. leaves that mix in other
+	// primitives are kept as they are, so no leaf changes the order its primitives are tested in
+	void pack_sphere_leaves() {
+		std::vector<shared_ptr<Hittable>> packed;
+		packed.reserve(primitives.size());
+
+		for (auto& node : nodes) {
+			if (node.primitive_count == 0)
+				continue;
+
+			size_t first = static_cast<size_t>(node.offset);
+			bool all_spheres = node.primitive_count > 1;
+			for (int k = 0; k < node.primitive_count && all_spheres; k++)
+				all_spheres = dynamic_cast<const Sphere*>(primitives[first + k].get()) != nullptr;
+
+			node.offset = static_cast<int32_t>(packed.size());
+			if (all_spheres) {
+				auto set = make_shared<SphereSet>();
+				for (int k = 0; k < node.primitive_count; k++)
+					set->add(static_cast<const Sphere&>(*primitives[first + k]));
+				packed.push_back(set);
+				node.primitive_count = 1;
+			}
+			else {
+				for (int k = 0; k < node.primitive_count; k++)
+					packed.push_back(primitives[first + k]);
+			}
+		}
+		primitives = std::move(packed);
+	}
+
+	enum class SplitResult { Split, Leaf, Fallback };
+
+	struct SAHBin {
+		AABB bbox;
+		int count = 0;
+	};
+
+	static int sah_bin_index(double centroid, const Interval& extent, int bin_count) {
+		int b = static_cast<int>(bin_count * ((centroid - extent.min) / extent.size()));
+		return (b < 0) ? 0 : (b >= bin_count) ? bin_count - 1 : b;
+	}
+
+	// pick the cheapest bucket boundary over all three axes and partition build[start, end) around it
+	SplitResult sah_split(std::vector<BuildPrimitive>& build, size_t start, size_t end, const AABB& bounds,
+		const AABB& centroid_bounds, bool fits_leaf, int& axis, size_t& mid) const {
+		int bin_count = options.sah_bins;
+		SAHBin bins[max_sah_bins];
+		double right_area[max_sah_bins];
+		int right_count[max_sah_bins];
+
+		double best_cost = infinity;
+		int best_axis = -1;
+		int best_split = 0;
+
+		for (int a = 0; a < 3; a++) {
+			const Interval& extent = centroid_bounds.axis(a);
+			if (extent.size() <= 0) continue;
+
+			for (int b = 0; b < bin_count; b++)
+				bins[b] = SAHBin();
+			for (size_t i = start; i < end; i++) {
+				auto& bin = bins[sah_bin_index(build[i].centroid[a], extent, bin_count)];
+				bin.count++;
+				bin.bbox = AABB(bin.bbox, build[i].bbox);
+			}
+
+			// sweep from the right to know what lies right of every boundary
+			AABB right_box;
+			int count = 0;
+			for (int b = bin_count - 1; b > 0; b--) {
+				right_box = AABB(right_box, bins[b].bbox);
+				count += bins[b].count;
+				right_count[b] = count;
+				right_area[b] = (count > 0) ? right_box.surface_area() : 0;
+			}
+
+			// boundary s puts bins [0, s) on the left and [s, bin_count) on the right
+			AABB left_box;
+			count = 0;
+			for (int s = 1; s < bin_count; s++) {
+				left_box = AABB(left_box, bins[s - 1].bbox);
+				count += bins[s - 1].count;
+				if (count == 0 || right_count[s] == 0) continue;
+
+				double cost = count * left_box.surface_area() + right_count[s] * right_area[s];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = a;
+					best_split = s;
+				}
+			}
+		}
+
+		if (best_axis < 0)
+			return SplitResult::Fallback;
+
+		double area = bounds.surface_area();
+		best_cost = options.traversal_cost + options.intersection_cost * best_cost / ((area > 0) ? area : 1);
+		double leaf_cost = options.intersection_cost * static_cast<double>(end - start);
+		if (fits_leaf && leaf_cost <= best_cost)
+			return SplitResult::Leaf;
+
+		const Interval& extent = centroid_bounds.axis(best_axis);
+		auto split_point = std::partition(build.begin() + start, build.begin() + end,
+			[&](const BuildPrimitive& p) { return sah_bin_index(p.centroid[best_axis], extent, bin_count) < best_split; });
+
+		axis = best_axis;
+		mid = static_cast<size_t>(split_point - build.begin());
+		return (mid == start || mid == end) ? SplitResult::Fallback : SplitResult::Split;
+	}
+
+	struct PacketStackEntry {
+		int node;
+		uint64_t mask; // rays of the packet that reached the parent
+	};
+
+	// bounds of the origins and inverse directions of a packet whose rays all share their direction signs
+	struct PacketFrustum {
+		double origin_min[3], origin_max[3];
+		double inv_min[3], inv_max[3];
+		int sign[3];
+	};
+
+	// false when the packet cannot be bounded: mixed direction signs, or a direction parallel to an axis
+	static bool make_frustum(const RayPacket& packet, PacketFrustum& frustum) {
+		for (int a = 0; a < 3; a++) {
+			frustum.sign[a] = packet.rays[0].sign(a);
+			frustum.origin_min[a] = frustum.origin_max[a] = packet.rays[0].origin()[a];
+			frustum.inv_min[a] = frustum.inv_max[a] = packet.rays[0].inv_direction()[a];
+
+			for (int k = 0; k < packet.size; k++) {
+				const Ray& r = packet.rays[k];
+				if (r.sign(a) != frustum.sign[a] || !std::isfinite(r.inv_direction()[a]))
+					return false;
+				frustum.origin_min[a] = std::min(frustum.origin_min[a], r.origin()[a]);
+				frustum.origin_max[a] = std::max(frustum.origin_max[a], r.origin()[a]);
+				frustum.inv_min[a] = std::min(frustum.inv_min[a], r.inv_direction()[a]);
+				frustum.inv_max[a] = std::max(frustum.inv_max[a], r.inv_direction()[a]);
+			}
+		}
+		return true;
+	}
+
+	// node_hit() in interval arithmetic over the whole packet. rounding is monotonic, so the bounds hold for the
+	// rounded slab distances of every ray too: false only when node_hit() is false for all of them
+	static bool frustum_hit(const LinearBVHNode& node, const PacketFrustum& f, double t_min, double t_max) {
+		for (int a = 0; a < 3; a++) {
+			double near_plane = f.sign[a] ? node.bounds_max[a] : node.bounds_min[a];
+			double far_plane = f.sign[a] ? node.bounds_min[a] : node.bounds_max[a];
+
+			double n0 = near_plane - f.origin_max[a], n1 = near_plane - f.origin_min[a];
+			double f0 = far_plane - f.origin_max[a], f1 = far_plane - f.origin_min[a];
+			double t0 = std::min(std::min(n0 * f.inv_min[a], n0 * f.inv_max[a]), std::min(n1 * f.inv_min[a], n1 * f.inv_max[a]));
+			double t1 = std::max(std::max(f0 * f.inv_min[a], f0 * f.inv_max[a]), std::max(f1 * f.inv_min[a], f1 * f.inv_max[a]));
+
+			t_min = (t0 > t_min) ? t0 : t_min;
+			t_max = (t1 < t_max) ? t1 : t_max;
+		}
+		return t_min < t_max;
+	}
+
+	// same branchless slab test as AABB::hit, on the float bounds of a node
+	static bool node_hit(const LinearBVHNode& node, const Ray& r, Interval ray_t) {
+		const Point3& orig = r.origin();
+		const Vec3& inv_dir = r.inv_direction();
+
+		for (int a = 0; a < 3; a++) {
+			double t0 = ((r.sign(a) ? node.bounds_max[a] : node.bounds_min[a]) - orig[a]) * inv_dir[a];
+			double t1 = ((r.sign(a) ? node.bounds_min[a] : node.bounds_max[a]) - orig[a]) * inv_dir[a];
+
+			ray_t.min = (t0 > ray_t.min) ? t0 : ray_t.min;
+			ray_t.max = (t1 < ray_t.max) ? t1 : ray_t.max;
+		}
+		return ray_t.min < ray_t.max;
+	}
+
+	static Point3 centroid_of(const AABB& box) {
+		return Point3(0.5 * (box.x.min + box.x.max), 0.5 * (box.y.min + box.y.max), 0.5 * (box.z.min + box.z.max));
+	}
+
+	static int longest_axis(const AABB& box) {
+		if (box.x.size() > box.y.size())
+			return box.x.size() > box.z.size() ? 0 : 2;
+		return box.y.size() > box.z.size() ? 1 : 2;
+	}
+
+	// round outwards, so the float box always contains the double one
+	static float round_down(double x) {
+		float f = static_cast<float>(x);
+		return (f > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+	}
+
+	static float round_up(double x) {
+		float f = static_cast<float>(x);
+		return (f < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+	}
+
+	static void set_bounds(LinearBVHNode& node, const AABB& box) {
+		for (int a = 0; a < 3; a++) {
+			node.bounds_min[a] = round_down(box.axis(a).min);
+			node.bounds_max[a] = round_up(box.axis(a).max);
+		}
+	}
+
+	static AABB to_aabb(const LinearBVHNode& node) {
+		return AABB(Interval(node.bounds_min[0], node.bounds_max[0]),
+					Interval(node.bounds_min[1], node.bounds_max[1]),
+					Interval(node.bounds_min[2], node.bounds_max[2]));
+	}
+};
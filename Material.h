@@ -6,11 +6,49 @@
 #include "Texture.h"
 #include "Color.h"
 
+#include <cstdint>
+
+enum class MaterialType : uint8_t
+{
+	Virtual,            // no table entry, dispatched through Material::scatter
+	Lambertian,         // solid albedo stored inline
+	LambertianTextured, // albedo looked up in a texture
+	Metal,
+	Dielectric,
+};
+
+inline const char* material_type_name(MaterialType type) {
+	switch (type) {
+	case MaterialType::Lambertian: return "lambertian";
+	case MaterialType::LambertianTextured: return "lambertian (textured)";
+	case MaterialType::Metal: return "metal";
+	case MaterialType::Dielectric: return "dielectric";
+	default: return "virtual";
+	}
+}
+
+/*
+	MaterialEntry
+	- one material of a MaterialTable: a type tag and the parameters its scatter needs, stored inline
+*/
+struct MaterialEntry
+{
+	MaterialType type = MaterialType::Virtual;
+	Color3 albedo;                      // Lambertian, Metal
+	double fuzz = 0;                    // Metal
+	double ir = 1;                      // Dielectric
+	const Texture* texture = nullptr;   // LambertianTextured
+	const Material* material = nullptr; // Virtual
+};
+
 class Material 
 {
 public:
 	virtual ~Material() = default;
-	virtual bool scatter(const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered) const = 0;
+	virtual bool scatter(const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered, RNG& rng) const = 0;
+
+	// fills the table entry of this material, false keeps it on the virtual call
+	virtual bool describe(MaterialEntry&) const { return false; }
 };
 
 class LambertianMaterial : public Material
@@ -19,14 +57,27 @@ public:
 	LambertianMaterial(const Color3& a) : albedo(make_shared<SolidColor>(a)) {}
 	LambertianMaterial(shared_ptr<Texture> a) : albedo(a) {}
 
-	bool scatter(const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered) const override {
-		auto scattered_direction = rec.normal + random_unit_vector();
+	bool scatter(const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered, RNG& rng) const override {
+		return scatter_with(albedo->value(rec.u, rec.v, rec.p), r, rec, atteunation, scattered, rng);
+	}
+
+	bool describe(MaterialEntry& entry) const override {
+		auto solid = dynamic_cast<const SolidColor*>(albedo.get());
+		entry.type = solid ? MaterialType::Lambertian : MaterialType::LambertianTextured;
+		entry.albedo = solid ? solid->color() : Color3(0, 0, 0);
+		entry.texture = albedo.get();
+		return true;
+	}
+
+	// the scatter itself, shared with MaterialTable
+	static bool scatter_with(const Color3& albedo, const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered, RNG& rng) {
+		auto scattered_direction = rec.normal + random_unit_vector(rng);
 
 		if(scattered_direction.near_zero()) 			
 			scattered_direction = rec.normal;
 
 		scattered = Ray(rec.p, scattered_direction, r.get_time());
-		atteunation = albedo->value(rec.u, rec.v, rec.p);
+		atteunation = albedo;
 		return true;
 	}
 
@@ -39,9 +90,20 @@ class MetalMaterial : public Material
 public:
 	MetalMaterial(const Color3& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
 
-	bool scatter(const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered) const override {
+	bool scatter(const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered, RNG& rng) const override {
+		return scatter_with(albedo, fuzz, r, rec, atteunation, scattered, rng);
+	}
+
+	bool describe(MaterialEntry& entry) const override {
+		entry.type = MaterialType::Metal;
+		entry.albedo = albedo;
+		entry.fuzz = fuzz;
+		return true;
+	}
+
+	static bool scatter_with(const Color3& albedo, double fuzz, const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered, RNG& rng) {
 		auto reflected = reflect(unit_vector(r.direction()), rec.normal);
-		scattered = Ray(rec.p, reflected + fuzz * random_unit_vector(), r.get_time());
+		scattered = Ray(rec.p, reflected + fuzz * random_unit_vector(rng), r.get_time());
 		atteunation = albedo;
 		return (dot(scattered.direction(), rec.normal) > 0);
 	}
@@ -56,8 +118,18 @@ class DielectricMaterial : public Material
 public:
 	DielectricMaterial(double index_of_refraction) : ir(index_of_refraction) {}
 
-	bool scatter(const Ray& r_in, const HitRecord& rec, Color3& attenuation, Ray& scattered)
+	bool scatter(const Ray& r_in, const HitRecord& rec, Color3& attenuation, Ray& scattered, RNG&)
 		const override {
+		return scatter_with(ir, r_in, rec, attenuation, scattered);
+	}
+
+	bool describe(MaterialEntry& entry) const override {
+		entry.type = MaterialType::Dielectric;
+		entry.ir = ir;
+		return true;
+	}
+
+	static bool scatter_with(double ir, const Ray& r_in, const HitRecord& rec, Color3& attenuation, Ray& scattered) {
 		attenuation = Color3(1.0, 1.0, 1.0);
 		double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
 		Vec3 unit_direction = unit_vector(r_in.direction());
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "utilities.h"
+
+#include "Hittable.h"
+#include "Material.h"
+
+#include <unordered_map>
+#include <vector>
+
+// scatters done by one material and the time spent in them, see Camera::sort_by_material
+struct MaterialShadingStats
+{
+	long long scatters = 0;
+	double seconds = 0;
+
+	MaterialShadingStats& operator+=(const MaterialShadingStats& other) {
+		scatters += other.scatters;
+		seconds += other.seconds;
+		return *this;
+	}
+};
+
+/*
+	MaterialTable
+	- the materials of a world in one flat array, numbered 0..n-1 in the order build() meets them
+	- the primitives keep the id of their material (Hittable::bind_materials) and copy it into HitRecord::material_id,
+	  the numbering lives in the table and the materials themselves are never written
+	- scatter() dispatches on the entry's type tag with a switch instead of a virtual call,
+	  so the common materials run without an indirect branch and their parameters sit next to each other
+	- materials that do not describe() themselves keep using their virtual scatter,
+	  and so do hits whose id is not this table's (a Hittable that does not bind_materials())
+*/
+class MaterialTable
+{
+public:
+	MaterialTable() {}
+	MaterialTable(const Hittable& world) { build(world); }
+
+	void build(const Hittable& world) {
+		entries.clear();
+		ids.clear();
+		world.bind_materials(*this);
+	}
+
+	// the id of material, appended under the next free id the first time it is seen
+	uint32_t add(const Material* material) {
+		auto found = ids.find(material);
+		if (found != ids.end())
+			return found->second;
+
+		MaterialEntry entry;
+		if (!material->describe(entry))
+			entry = MaterialEntry();
+		entry.material = material;
+
+		uint32_t id = static_cast<uint32_t>(entries.size());
+		entries.push_back(entry);
+		ids.emplace(material, id);
+		return id;
+	}
+
+	size_t size() const { return entries.size(); }
+	bool contains(uint32_t id) const { return id < entries.size(); }
+	bool contains(const Material* material) const { return ids.count(material) != 0; }
+	const MaterialEntry& entry(uint32_t id) const { return entries[id]; }
+
+	// same result as rec.mat->scatter()
+	bool scatter(const Ray& r, const HitRecord& rec, Color3& atteunation, Ray& scattered, RNG& rng) const {
+		// the id is only trusted when it points back at rec.mat: a primitive shared with another world may hold that table's id
+		if (!contains(rec.material_id) || entries[rec.material_id].material != rec.mat)
+			return rec.mat->scatter(r, rec, atteunation, scattered, rng);
+
+		const MaterialEntry& e = entries[rec.material_id];
+		switch (e.type) {
+		case MaterialType::Lambertian:
+			return LambertianMaterial::scatter_with(e.albedo, r, rec, atteunation, scattered, rng);
+		case MaterialType::LambertianTextured:
+			return LambertianMaterial::scatter_with(e.texture->value(rec.u, rec.v, rec.p), r, rec, atteunation, scattered, rng);
+		case MaterialType::Metal:
+			return MetalMaterial::scatter_with(e.albedo, e.fuzz, r, rec, atteunation, scattered, rng);
+		case MaterialType::Dielectric:
+			return DielectricMaterial::scatter_with(e.ir, r, rec, atteunation, scattered);
+		default:
+			return e.material->scatter(r, rec, atteunation, scattered, rng);
+		}
+	}
+
+private:
+	std::vector<MaterialEntry> entries;
+	std::unordered_map<const Material*, uint32_t> ids; // the numbering handed out by add()
+};
@@ -2,6 +2,10 @@
 
 #include "utilities.h"
 #include "Hittable.h"
+#include "Material.h"
+#include "MaterialTable.h"
+#include "RenderStats.h"
+#include <atomic>
 #include <cmath>
 
 class Quad : public Hittable
@@ -20,6 +24,7 @@ public:
 	~Quad() {}
 
 	bool hit(const Ray& ray, Interval ray_t, HitRecord& rec) const {
+		SRT_STAT(quad_tests);
 		auto denominator = dot(normal, ray.direction());
 
 		if (fabs(denominator) < 1e-8) { // if nearly parallel to the plane, return false
@@ -41,8 +46,10 @@ public:
 
 		rec.t = t;
 		rec.p = intersection;
-		rec.mat = mat;
+		rec.mat = mat.get();
+		rec.material_id = material_id.load(std::memory_order_relaxed);
 		rec.set_face_normal(ray, normal);
+		SRT_STAT(primitive_hits);
 
 		return true;
 	}
@@ -62,11 +69,16 @@ public:
 
 	AABB bounding_box()  const { return bbox; }
 
+	void bind_materials(MaterialTable& table) const override {
+		if (mat) material_id.store(table.add(mat.get()), std::memory_order_relaxed);
+	}
+
 private:
 	Point3 Q;
 	Vec3 u, v;
 	AABB bbox;
 	shared_ptr<Material> mat;
+	mutable std::atomic<uint32_t> material_id{ 0 }; // set by bind_materials()
 	Vec3 normal;
 	double D;
 	Vec3 w;
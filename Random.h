@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+	RNG
+	- PCG32 (XSH-RR) generator: 64 bits of state, 32 bit output
+	- (seed, stream) selects one of 2^63 independent sequences, so every pixel sample can own its own stream
+*/
+class RNG
+{
+public:
+	RNG() : RNG(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL) {}
+	RNG(uint64_t seed, uint64_t stream) { set_sequence(seed, stream); }
+
+	void set_sequence(uint64_t seed, uint64_t stream) {
+		state = 0;
+		inc = (stream << 1u) | 1u; // increment must be odd
+		next_uint();
+		state += seed;
+		next_uint();
+	}
+
+	uint32_t next_uint() {
+		uint64_t old_state = state;
+		state = old_state * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+		uint32_t rot = static_cast<uint32_t>(old_state >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+	}
+
+	// [0, 1)
+	double next_double() {
+		return next_uint() / 4294967296.0;
+	}
+
+	// stream of the sample-th sample of pixel (i, j).
+	// it depends only on its arguments, so the image does not depend on the order samples are taken in.
+	static RNG for_pixel_sample(uint64_t seed, int i, int j, int sample) {
+		uint64_t pixel = (static_cast<uint64_t>(static_cast<uint32_t>(j)) << 32) | static_cast<uint32_t>(i);
+		uint64_t key = mix(seed ^ mix(pixel));
+		return RNG(mix(key + static_cast<uint32_t>(sample)), key);
+	}
+
+private:
+	uint64_t state;
+	uint64_t inc;
+
+	// splitmix64 finalizer
+	static uint64_t mix(uint64_t x) {
+		x += 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+};
@@ -7,16 +7,24 @@ private:
 	Point3 orig;
 	Vec3 dir;
 	double time;
+	// precomputed once per ray for the slab tests of every box it is tested against
+	Vec3 inv_dir;
+	int dir_sign[3]; // 1 where the direction is negative
 
 public:
-	Ray() {}
-	Ray(const Point3& origin, const Vec3& direction) : orig(origin), dir(direction), time(0.0) {}
-	Ray(const Point3& origin, const Vec3& direction, double time = 0.0) : orig(origin), dir(direction), time(time) {}
+	Ray() : time(0.0), dir_sign{ 0, 0, 0 } {}
+	Ray(const Point3& origin, const Vec3& direction, double time = 0.0)
+		: orig(origin), dir(direction), time(time),
+		  inv_dir(1.0 / direction[0], 1.0 / direction[1], 1.0 / direction[2]),
+		  dir_sign{ inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 } {}
 
-	Point3 origin() const { return orig; }
-	Vec3 direction() const { return dir; }
+	const Point3& origin() const { return orig; }
+	const Vec3& direction() const { return dir; }
 	double get_time() const { return time; }
 
+	const Vec3& inv_direction() const { return inv_dir; }
+	int sign(int axis) const { return dir_sign[axis]; }
+
 	Point3 at(double t) const {
 		return orig + t * dir;
 	}
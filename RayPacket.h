@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Ray.h"
+
+#include <cstdint>
+
+/*
+	RayPacket
+	- up to 64 rays traced together, e.g. the camera rays of a block of neighbouring pixels
+	- Hittable::hit_packet() answers with a bit mask: bit k is set when rays[k] hit something
+*/
+struct RayPacket
+{
+	static const int max_size = 64;
+
+	Ray rays[max_size];
+	int size = 0;
+
+	void add(const Ray& r) { rays[size++] = r; }
+
+	// bit mask of every ray in the packet
+	uint64_t all() const { return (size >= max_size) ? ~0ULL : ((1ULL << size) - 1); }
+};
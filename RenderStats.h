@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+// counters cost nothing unless the build defines SRT_ENABLE_STATS
+#if defined(SRT_ENABLE_STATS)
+#define SRT_STAT(counter) (RenderStats::local().counter++)
+#define SRT_STAT_ADD(counter, n) (RenderStats::local().counter += (n))
+#define SRT_STAT_PATH(length) (RenderStats::local().record_path(length))
+#else
+#define SRT_STAT(counter) ((void)0)
+#define SRT_STAT_ADD(counter, n) ((void)0)
+#define SRT_STAT_PATH(length) ((void)0)
+#endif
+
+/*
+	RenderStats
+	- ray and intersection counters, one set per thread so the hot path never synchronizes
+	- a thread's counters are folded into a shared total when it exits; snapshot() adds the calling thread's
+*/
+class RenderStats
+{
+public:
+	static const int path_buckets = 17; // path lengths 0 .. 15, and 16 or longer
+
+	long long primary_rays = 0;
+	long long secondary_rays = 0;
+	long long ray_hits = 0; // rays that hit the scene
+	long long bvh_nodes_visited = 0;
+	long long aabb_tests = 0;
+	long long sphere_tests = 0;
+	long long quad_tests = 0;
+	long long primitive_hits = 0; // sphere and quad tests that found an intersection
+	long long path_lengths[path_buckets] = {}; // paths by number of segments traced
+
+	void record_path(int length) {
+		path_lengths[std::min(std::max(length, 0), path_buckets - 1)]++;
+	}
+
+	RenderStats& operator+=(const RenderStats& other) {
+		primary_rays += other.primary_rays;
+		secondary_rays += other.secondary_rays;
+		ray_hits += other.ray_hits;
+		bvh_nodes_visited += other.bvh_nodes_visited;
+		aabb_tests += other.aabb_tests;
+		sphere_tests += other.sphere_tests;
+		quad_tests += other.quad_tests;
+		primitive_hits += other.primitive_hits;
+		for (int k = 0; k < path_buckets; k++)
+			path_lengths[k] += other.path_lengths[k];
+		return *this;
+	}
+
+	long long rays() const { return primary_rays + secondary_rays; }
+
+	double average_path_length() const {
+		long long paths = 0;
+		long long segments = 0;
+		for (int k = 0; k < path_buckets; k++) {
+			paths += path_lengths[k];
+			segments += path_lengths[k] * k;
+		}
+		return (paths > 0) ? static_cast<double>(segments) / paths : 0.0;
+	}
+
+	void print(std::ostream& out) const {
+		double rays_traced = (rays() > 0) ? static_cast<double>(rays()) : 1.0;
+		out << "rays: " << primary_rays << " primary, " << secondary_rays << " secondary, "
+			<< ray_hits << " hit the scene\n";
+		out << "per ray: " << bvh_nodes_visited / rays_traced << " bvh nodes, " << aabb_tests / rays_traced << " box tests, "
+			<< (sphere_tests + quad_tests) / rays_traced << " primitive tests\n";
+		out << "primitive tests: " << sphere_tests << " sphere, " << quad_tests << " quad, " << primitive_hits << " hits\n";
+		out << "average path length: " << average_path_length() << " segments\n";
+	}
+
+	std::string to_json() const {
+		std::ostringstream out;
+		out << "{\n";
+		out << "  \"primary_rays\": " << primary_rays << ",\n";
+		out << "  \"secondary_rays\": " << secondary_rays << ",\n";
+		out << "  \"ray_hits\": " << ray_hits << ",\n";
+		out << "  \"bvh_nodes_visited\": " << bvh_nodes_visited << ",\n";
+		out << "  \"aabb_tests\": " << aabb_tests << ",\n";
+		out << "  \"sphere_tests\": " << sphere_tests << ",\n";
+		out << "  \"quad_tests\": " << quad_tests << ",\n";
+		out << "  \"primitive_hits\": " << primitive_hits << ",\n";
+		out << "  \"path_lengths\": [";
+		for (int k = 0; k < path_buckets; k++)
+			out << (k ? ", " : "") << path_lengths[k];
+		out << "]\n";
+		out << "}\n";
+		return out.str();
+	}
+
+	// counters of the calling thread
+	static RenderStats& local();
+
+	// every exited thread plus the calling one
+	static RenderStats snapshot() {
+		std::lock_guard<std::mutex> lock(mutex());
+		RenderStats total = retired();
+		total += local();
+		return total;
+	}
+
+	// clears the shared total and the calling thread, call it while no other thread is counting
+	static void reset() {
+		std::lock_guard<std::mutex> lock(mutex());
+		retired() = RenderStats();
+		local() = RenderStats();
+	}
+
+private:
+	struct ThreadStats;
+
+	static std::mutex& mutex() {
+		static std::mutex m;
+		return m;
+	}
+
+	static RenderStats& retired() {
+		static RenderStats total;
+		return total;
+	}
+};
+
+// folds a thread's counters into the shared total when the thread exits
+struct RenderStats::ThreadStats
+{
+	RenderStats stats;
+
+	~ThreadStats() {
+		std::lock_guard<std::mutex> lock(mutex());
+		retired() += stats;
+	}
+};
+
+inline RenderStats& RenderStats::local() {
+	thread_local ThreadStats thread_stats;
+	return thread_stats.stats;
+}
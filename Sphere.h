@@ -1,5 +1,10 @@
 #pragma once
 #include "Hittable.h"
+#include "Material.h"
+#include "MaterialTable.h"
+#include "RenderStats.h"
+
+#include <atomic>
 
 class Sphere : public Hittable
 {
@@ -21,14 +26,14 @@ public:
 
     AABB bounding_box() const override { return bbox; }
 
+    void bind_materials(MaterialTable& table) const override { material_id.store(table.add(mat.get()), std::memory_order_relaxed); }
+
     bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+        SRT_STAT(sphere_tests);
         Point3 center = is_moving ? sphere_center(r.get_time()) : center1;
-        Vec3 oc = r.origin() - center;
         auto a = r.direction().length_squared();
-        auto half_b = dot(oc, r.direction());
-        auto c = oc.length_squared() - radius * radius;
-
-        auto discriminant = half_b * half_b - a * c;
+        double half_b;
+        auto discriminant = sphere_discriminant(center, radius, r, a, half_b);
         if (discriminant < 0) return false;
         auto sqrtd = sqrt(discriminant);
 
@@ -47,12 +52,16 @@ public:
         // otherwise, -outward_normal
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
-        rec.mat = mat; // record material into hit record
+        rec.mat = mat.get(); // record material into hit record
+        rec.material_id = material_id.load(std::memory_order_relaxed);
+        SRT_STAT(primitive_hits);
 
         return true;
     }
 
 private:
+    friend class SphereSet; // packs spheres into SoA form and shares get_sphere_uv
+
     static void get_sphere_uv(const Point3& p, double& u, double& v) {
         // p: a given point on the sphere of radius one, centered at the origin.
         // u: returned value [0,1] of angle around the Y axis from X=-1.
@@ -68,10 +77,20 @@ private:
         v = theta / pi;
     }
 
+    // discriminant of the ray against a sphere, a = r.direction().length_squared().
+    // SphereSet calls it too so both round the same way, also when the compiler fuses it into FMAs
+    static double sphere_discriminant(const Point3& center, double radius, const Ray& r, double a, double& half_b) {
+        Vec3 oc = r.origin() - center;
+        half_b = dot(oc, r.direction());
+        auto c = oc.length_squared() - radius * radius;
+        return half_b * half_b - a * c;
+    }
+
 private:
     Point3 center1;
     double radius;
     shared_ptr<Material> mat;
+    mutable std::atomic<uint32_t> material_id{ 0 }; // set by bind_materials()
     bool is_moving;
     Vec3 center_vec;
     AABB bbox;
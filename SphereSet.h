@@ -0,0 +1,274 @@
+#pragma once
+
+#include "utilities.h"
+
+#include "Hittable.h"
+#include "Material.h"
+#include "RenderStats.h"
+#include "Sphere.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SRT_SPHERE_SET_SSE 1
+#endif
+#if defined(__AVX__)
+#define SRT_SPHERE_SET_AVX 1
+#endif
+
+#if defined(SRT_SPHERE_SET_AVX) || defined(SRT_SPHERE_SET_SSE)
+#include <immintrin.h>
+#endif
+
+/*
+	SphereSet
+	- a few spheres stored axis by axis (SoA), the leaf type LinearBVH packs all-sphere leaves into
+	- the discriminants of 4 spheres are computed at once with AVX (or twice 2 with SSE2) to reject the spheres
+	  the ray clearly misses, the discriminant of the others is computed again with Sphere::sphere_discriminant
+	- the SIMD code rounds differently from the scalar code once the compiler fuses the latter into FMAs,
+	  so it only rejects a sphere beyond a bound on that rounding error and never decides a hit itself.
+	  sphere_set_check compares every path this build has against a loop of Sphere::hit
+*/
+class SphereSet : public Hittable
+{
+public:
+	static const int lanes = 4;
+
+	// how the discriminants of a group are computed, every build has Scalar
+	enum class Path { Scalar, SSE2, AVX };
+
+	static bool has_path(Path path) {
+		switch (path) {
+#if defined(SRT_SPHERE_SET_AVX)
+		case Path::AVX: return true;
+#endif
+#if defined(SRT_SPHERE_SET_SSE)
+		case Path::SSE2: return true;
+#endif
+		case Path::Scalar: return true;
+		default: return false;
+		}
+	}
+
+	// the path hit() takes: the widest one this build has
+	static Path widest_path() {
+#if defined(SRT_SPHERE_SET_AVX)
+		return Path::AVX;
+#elif defined(SRT_SPHERE_SET_SSE)
+		return Path::SSE2;
+#else
+		return Path::Scalar;
+#endif
+	}
+
+	void add(const Sphere& sphere) {
+		// padding lanes are NaN spheres that never hit, drop them before appending
+		center_x.resize(count); center_y.resize(count); center_z.resize(count);
+		motion_x.resize(count); motion_y.resize(count); motion_z.resize(count);
+		radius.resize(count); moving.resize(count); error_scale.resize(count);
+
+		center_x.push_back(sphere.center1.x()); center_y.push_back(sphere.center1.y()); center_z.push_back(sphere.center1.z());
+		motion_x.push_back(sphere.center_vec.x()); motion_y.push_back(sphere.center_vec.y()); motion_z.push_back(sphere.center_vec.z());
+		radius.push_back(sphere.radius);
+		moving.push_back(sphere.is_moving ? all_bits() : 0.0);
+		auto extent = abs_sum(sphere.center1) + abs_sum(sphere.center_vec);
+		error_scale.push_back(sphere.radius * sphere.radius + 2 * extent * extent);
+		materials.push_back(sphere.mat);
+		material_ids.emplace_back(0u);
+		bbox = (count == 0) ? sphere.bounding_box() : AABB(bbox, sphere.bounding_box());
+		count++;
+
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		size_t padded = (count + lanes - 1) / lanes * lanes;
+		for (auto component : { &center_x, &center_y, &center_z })
+			component->resize(padded, nan);
+		for (auto component : { &motion_x, &motion_y, &motion_z, &radius, &moving, &error_scale })
+			component->resize(padded, 0.0);
+	}
+
+	size_t size() const { return count; }
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+		return hit_on(widest_path(), r, ray_t, rec);
+	}
+
+	// hit() with the discriminants of the given path, which has_path() must allow
+	bool hit_on(Path path, const Ray& r, Interval ray_t, HitRecord& rec) const {
+		SRT_STAT_ADD(sphere_tests, count);
+		auto a = r.direction().length_squared();
+		auto origin_extent = abs_sum(r.origin());
+		// a sphere is rejected when its SIMD discriminant is below -slack * (|oc|^2 + error_scale + origin_error),
+		// some thousand times the rounding error of either computation
+		auto slack = 1e-12 * a;
+		auto origin_error = 2 * origin_extent * origin_extent;
+		size_t closest = count;
+		double closest_root = 0;
+
+		for (size_t group = 0; group < count; group += lanes) {
+			int candidates = candidate_lanes(path, group, r, a, slack, origin_error);
+
+			// lanes in order, each hit narrows the interval for the next one like consecutive Sphere::hit calls
+			for (int lane = 0; lane < lanes && candidates != 0; lane++) {
+				if (!((candidates >> lane) & 1))
+					continue;
+
+				size_t s = group + lane;
+				Point3 center(center_x[s], center_y[s], center_z[s]);
+				if (std::isnan(moving[s])) // the all bits mask
+					center = center + r.get_time() * Vec3(motion_x[s], motion_y[s], motion_z[s]);
+				double half_b;
+				auto discriminant = Sphere::sphere_discriminant(center, radius[s], r, a, half_b);
+				if (discriminant < 0)
+					continue;
+
+				auto sqrtd = sqrt(discriminant);
+				auto root = (-half_b - sqrtd) / a;
+				if (!ray_t.surrounds(root)) {
+					root = (-half_b + sqrtd) / a;
+					if (!ray_t.surrounds(root))
+						continue;
+				}
+
+				closest = s;
+				closest_root = root;
+				ray_t.max = root;
+				SRT_STAT(primitive_hits);
+			}
+		}
+		if (closest == count)
+			return false;
+
+		Point3 center1(center_x[closest], center_y[closest], center_z[closest]);
+		rec.t = closest_root;
+		rec.p = r.at(rec.t);
+		Vec3 outward_normal = (rec.p - center1) / radius[closest];
+		rec.set_face_normal(r, outward_normal);
+		Sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+		rec.mat = materials[closest].get();
+		rec.material_id = material_ids[closest].load(std::memory_order_relaxed);
+		return true;
+	}
+
+	AABB bounding_box() const override { return bbox; }
+
+	void bind_materials(MaterialTable& table) const override {
+		for (size_t k = 0; k < count; k++)
+			material_ids[k].store(table.add(materials[k].get()), std::memory_order_relaxed);
+	}
+
+private:
+	size_t count = 0;
+	std::vector<double> center_x, center_y, center_z;
+	std::vector<double> motion_x, motion_y, motion_z;
+	std::vector<double> radius;
+	std::vector<double> moving; // every bit set for moving spheres, so it works as a blend mask
+	std::vector<double> error_scale; // radius^2 + 2 (|center1|_1 + |motion|_1)^2, scales the rounding error of the discriminant
+	std::vector<shared_ptr<Material>> materials;
+	mutable std::deque<std::atomic<uint32_t>> material_ids; // set by bind_materials(), a deque because atomics do not move
+	AABB bbox;
+
+	static double abs_sum(const Vec3& v) { return std::fabs(v.x()) + std::fabs(v.y()) + std::fabs(v.z()); }
+
+	static double all_bits() {
+		uint64_t bits = ~0ULL;
+		double mask;
+		std::memcpy(&mask, &bits, sizeof(mask));
+		return mask;
+	}
+
+	// bit k set unless the sphere group + k is missed by more than the slack, padding lanes are always clear
+	int candidate_lanes(Path path, size_t group, const Ray& r, double a, double slack, double origin_error) const {
+		switch (path) {
+#if defined(SRT_SPHERE_SET_AVX)
+		case Path::AVX: return candidate_lanes_avx(group, r, a, slack, origin_error);
+#endif
+#if defined(SRT_SPHERE_SET_SSE)
+		case Path::SSE2: return candidate_lanes_sse(group, r, a, slack, origin_error);
+#endif
+		default: {
+			// no SIMD, every real sphere goes straight to the exact test
+			(void)r; (void)a; (void)slack; (void)origin_error;
+			int real = static_cast<int>(std::min<size_t>(lanes, count - group));
+			return (1 << real) - 1;
+		}
+		}
+	}
+
+#if defined(SRT_SPHERE_SET_AVX)
+	int candidate_lanes_avx(size_t group, const Ray& r, double a, double slack, double origin_error) const {
+		__m256d time = _mm256_set1_pd(r.get_time());
+		__m256d c1x = _mm256_loadu_pd(&center_x[group]);
+		__m256d c1y = _mm256_loadu_pd(&center_y[group]);
+		__m256d c1z = _mm256_loadu_pd(&center_z[group]);
+		__m256d is_moving = _mm256_loadu_pd(&moving[group]);
+		__m256d cx = _mm256_blendv_pd(c1x, _mm256_add_pd(c1x, _mm256_mul_pd(time, _mm256_loadu_pd(&motion_x[group]))), is_moving);
+		__m256d cy = _mm256_blendv_pd(c1y, _mm256_add_pd(c1y, _mm256_mul_pd(time, _mm256_loadu_pd(&motion_y[group]))), is_moving);
+		__m256d cz = _mm256_blendv_pd(c1z, _mm256_add_pd(c1z, _mm256_mul_pd(time, _mm256_loadu_pd(&motion_z[group]))), is_moving);
+
+		__m256d ocx = _mm256_sub_pd(_mm256_set1_pd(r.origin().x()), cx);
+		__m256d ocy = _mm256_sub_pd(_mm256_set1_pd(r.origin().y()), cy);
+		__m256d ocz = _mm256_sub_pd(_mm256_set1_pd(r.origin().z()), cz);
+		__m256d dx = _mm256_set1_pd(r.direction().x());
+		__m256d dy = _mm256_set1_pd(r.direction().y());
+		__m256d dz = _mm256_set1_pd(r.direction().z());
+
+		__m256d hb = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+		__m256d rad = _mm256_loadu_pd(&radius[group]);
+		__m256d oc2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz));
+		__m256d c = _mm256_sub_pd(oc2, _mm256_mul_pd(rad, rad));
+		__m256d disc = _mm256_sub_pd(_mm256_mul_pd(hb, hb), _mm256_mul_pd(_mm256_set1_pd(a), c));
+
+		__m256d scale = _mm256_add_pd(_mm256_add_pd(oc2, _mm256_loadu_pd(&error_scale[group])), _mm256_set1_pd(origin_error));
+		__m256d bound = _mm256_add_pd(disc, _mm256_mul_pd(_mm256_set1_pd(slack), scale));
+		return _mm256_movemask_pd(_mm256_cmp_pd(bound, _mm256_setzero_pd(), _CMP_GE_OQ));
+	}
+#endif
+
+#if defined(SRT_SPHERE_SET_SSE)
+	int candidate_lanes_sse(size_t group, const Ray& r, double a, double slack, double origin_error) const {
+		int mask = 0;
+		for (int block = 0; block < lanes; block += 2) {
+			size_t s = group + block;
+			__m128d time = _mm_set1_pd(r.get_time());
+			__m128d is_moving = _mm_loadu_pd(&moving[s]);
+			__m128d c1x = _mm_loadu_pd(&center_x[s]);
+			__m128d c1y = _mm_loadu_pd(&center_y[s]);
+			__m128d c1z = _mm_loadu_pd(&center_z[s]);
+			__m128d cx = blend(c1x, _mm_add_pd(c1x, _mm_mul_pd(time, _mm_loadu_pd(&motion_x[s]))), is_moving);
+			__m128d cy = blend(c1y, _mm_add_pd(c1y, _mm_mul_pd(time, _mm_loadu_pd(&motion_y[s]))), is_moving);
+			__m128d cz = blend(c1z, _mm_add_pd(c1z, _mm_mul_pd(time, _mm_loadu_pd(&motion_z[s]))), is_moving);
+
+			__m128d ocx = _mm_sub_pd(_mm_set1_pd(r.origin().x()), cx);
+			__m128d ocy = _mm_sub_pd(_mm_set1_pd(r.origin().y()), cy);
+			__m128d ocz = _mm_sub_pd(_mm_set1_pd(r.origin().z()), cz);
+			__m128d dx = _mm_set1_pd(r.direction().x());
+			__m128d dy = _mm_set1_pd(r.direction().y());
+			__m128d dz = _mm_set1_pd(r.direction().z());
+
+			__m128d hb = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, dx), _mm_mul_pd(ocy, dy)), _mm_mul_pd(ocz, dz));
+			__m128d rad = _mm_loadu_pd(&radius[s]);
+			__m128d oc2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz));
+			__m128d c = _mm_sub_pd(oc2, _mm_mul_pd(rad, rad));
+			__m128d disc = _mm_sub_pd(_mm_mul_pd(hb, hb), _mm_mul_pd(_mm_set1_pd(a), c));
+
+			__m128d scale = _mm_add_pd(_mm_add_pd(oc2, _mm_loadu_pd(&error_scale[s])), _mm_set1_pd(origin_error));
+			__m128d bound = _mm_add_pd(disc, _mm_mul_pd(_mm_set1_pd(slack), scale));
+			mask |= _mm_movemask_pd(_mm_cmpge_pd(bound, _mm_setzero_pd())) << block;
+		}
+		return mask;
+	}
+#endif
+
+#if defined(SRT_SPHERE_SET_SSE)
+	// mask ? b : a, SSE2 has no blendv
+	static __m128d blend(__m128d a, __m128d b, __m128d mask) {
+		return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a));
+	}
+#endif
+};
@@ -20,6 +20,8 @@ public:
 		return color_value;
 	}
 
+	const Color3& color() const { return color_value; }
+
 private:
 	Color3 color_value;
 };
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+	Tile
+	- a rectangular block of pixels, [x0, x1) x [y0, y1)
+*/
+struct Tile
+{
+	int index;
+	int x0, y0;
+	int x1, y1;
+};
+
+/*
+	TileScheduler
+	- Split the image into tiles
+	- Hand the tiles to a pool of work-stealing worker threads, kept from one run() to the next
+*/
+class TileScheduler
+{
+public:
+	TileScheduler(int image_width, int image_height, int tile_size) {
+		tile_size = (tile_size < 1) ? 1 : tile_size;
+
+		// tiles are ordered row by row, so tile index is stable for a given image and tile size
+		for (int y = 0; y < image_height; y += tile_size) {
+			for (int x = 0; x < image_width; x += tile_size) {
+				Tile tile;
+				tile.index = static_cast<int>(tiles.size());
+				tile.x0 = x;
+				tile.y0 = y;
+				tile.x1 = std::min(x + tile_size, image_width);
+				tile.y1 = std::min(y + tile_size, image_height);
+				tiles.push_back(tile);
+			}
+		}
+	}
+
+	const std::vector<Tile>& get_tiles() const { return tiles; }
+
+	// 0 or negative means "use every hardware thread"
+	static int resolve_thread_count(int requested) {
+		if (requested > 0) return requested;
+		int hardware = static_cast<int>(std::thread::hardware_concurrency());
+		return (hardware < 1) ? 1 : hardware;
+	}
+
+	// every worker starts with a contiguous block of tiles; workers that finish early steal the rest
+	void run(int thread_count, const std::function<void(const Tile&)>& render_tile) {
+		int n = std::max(1, std::min(resolve_thread_count(thread_count), static_cast<int>(tiles.size())));
+		if (!scheduler || scheduler->worker_count() != n)
+			scheduler.reset(new WorkStealingScheduler(n));
+
+		std::vector<WorkStealingScheduler::Task> tasks;
+		tasks.reserve(tiles.size());
+		for (const auto& tile : tiles)
+			tasks.push_back([&render_tile, &tile]() { render_tile(tile); });
+
+		scheduler->run(std::move(tasks));
+		worker_stats = scheduler->get_worker_stats();
+	}
+
+	// busy/idle time of each worker during the last run()
+	const std::vector<WorkStealingScheduler::WorkerStats>& get_worker_stats() const { return worker_stats; }
+
+private:
+	std::vector<Tile> tiles;
+	std::unique_ptr<WorkStealingScheduler> scheduler;
+	std::vector<WorkStealingScheduler::WorkerStats> worker_stats;
+};
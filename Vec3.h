@@ -54,11 +54,19 @@ public:
 	}
 
 	static Vec3 random() {
-		return Vec3(random_double(), random_double(), random_double());
+		return random(thread_rng());
 	}
 
 	static Vec3 random(double min, double max) {
-		return Vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+		return random(thread_rng(), min, max);
+	}
+
+	static Vec3 random(RNG& rng) {
+		return Vec3(random_double(rng), random_double(rng), random_double(rng));
+	}
+
+	static Vec3 random(RNG& rng, double min, double max) {
+		return Vec3(random_double(rng, min, max), random_double(rng, min, max), random_double(rng, min, max));
 	}
 };
 
@@ -108,28 +116,28 @@ inline Vec3 unit_vector(Vec3 v) {
 	return v / v.length();
 }
 
-inline Vec3 random_in_unit_sphere() {
+inline Vec3 random_in_unit_sphere(RNG& rng) {
 	while (true) {
-		auto p = Vec3::random(-1, 1);
+		auto p = Vec3::random(rng, -1, 1);
 		if (p.length_squared() < 1) 
 			return p;
 	}
 }
 
-inline Vec3 random_unit_vector() {
-	return unit_vector(random_in_unit_sphere());
+inline Vec3 random_unit_vector(RNG& rng) {
+	return unit_vector(random_in_unit_sphere(rng));
 }
 
-inline Vec3 random_in_unit_disk() {
+inline Vec3 random_in_unit_disk(RNG& rng) {
 	while (true) {
-		auto p = Vec3(random_double(-1, 1), random_double(-1, 1), 0);
+		auto p = Vec3(random_double(rng, -1, 1), random_double(rng, -1, 1), 0);
 		if (p.length_squared() < 1) 
 			return p;
 	}
 }
 
-inline Vec3 random_on_hemisphere(const Vec3& normal) {
-	Vec3 on_unit_sphere = random_in_unit_sphere();
+inline Vec3 random_on_hemisphere(RNG& rng, const Vec3& normal) {
+	Vec3 on_unit_sphere = random_in_unit_sphere(rng);
 	if (dot(on_unit_sphere, normal) > 0.0) 
 		return on_unit_sphere;
 	else 
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "utilities.h"
+
+#include "Color.h"
+#include "Hittable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/*
+	PathBuffer
+	- the state of a batch of paths for the wavefront integrator (Camera::wavefront), one array per component
+	- a stage touches only the arrays it needs, and consecutive paths of a queue sit next to each other
+*/
+struct PathBuffer
+{
+	std::vector<double> origin_x, origin_y, origin_z;
+	std::vector<double> direction_x, direction_y, direction_z;
+	std::vector<double> time;
+	std::vector<double> throughput_r, throughput_g, throughput_b; // product of the attenuations so far
+	std::vector<double> color_r, color_g, color_b; // radiance of the finished path
+	std::vector<RNG> rng;
+	std::vector<uint32_t> pixel; // framebuffer index
+
+	size_t size() const { return pixel.size(); }
+
+	void resize(size_t n) {
+		for (auto component : { &origin_x, &origin_y, &origin_z, &direction_x, &direction_y, &direction_z, &time,
+			&throughput_r, &throughput_g, &throughput_b, &color_r, &color_g, &color_b })
+			component->resize(n);
+		rng.resize(n);
+		pixel.resize(n);
+	}
+
+	Ray ray(size_t k) const {
+		return Ray(Point3(origin_x[k], origin_y[k], origin_z[k]), Vec3(direction_x[k], direction_y[k], direction_z[k]), time[k]);
+	}
+
+	void set_ray(size_t k, const Ray& r) {
+		origin_x[k] = r.origin().x(); origin_y[k] = r.origin().y(); origin_z[k] = r.origin().z();
+		direction_x[k] = r.direction().x(); direction_y[k] = r.direction().y(); direction_z[k] = r.direction().z();
+		time[k] = r.get_time();
+	}
+
+	Color3 throughput(size_t k) const { return Color3(throughput_r[k], throughput_g[k], throughput_b[k]); }
+
+	void set_throughput(size_t k, const Color3& c) {
+		throughput_r[k] = c.x(); throughput_g[k] = c.y(); throughput_b[k] = c.z();
+	}
+
+	Color3 color(size_t k) const { return Color3(color_r[k], color_g[k], color_b[k]); }
+
+	void set_color(size_t k, const Color3& c) {
+		color_r[k] = c.x(); color_g[k] = c.y(); color_b[k] = c.z();
+	}
+};
+
+/*
+	HitBuffer
+	- the closest hit of every path of a PathBuffer, written by the extend stage and read by the shade stage
+*/
+struct HitBuffer
+{
+	std::vector<double> t;
+	std::vector<double> p_x, p_y, p_z;
+	std::vector<double> normal_x, normal_y, normal_z;
+	std::vector<double> u, v;
+	std::vector<uint8_t> front_face;
+	std::vector<const Material*> mat;
+	std::vector<uint32_t> material_id;
+
+	void resize(size_t n) {
+		for (auto component : { &t, &p_x, &p_y, &p_z, &normal_x, &normal_y, &normal_z, &u, &v })
+			component->resize(n);
+		front_face.resize(n);
+		mat.resize(n);
+		material_id.resize(n);
+	}
+
+	HitRecord record(size_t k) const {
+		HitRecord rec;
+		rec.t = t[k];
+		rec.p = Point3(p_x[k], p_y[k], p_z[k]);
+		rec.normal = Vec3(normal_x[k], normal_y[k], normal_z[k]);
+		rec.u = u[k];
+		rec.v = v[k];
+		rec.front_face = front_face[k] != 0;
+		rec.mat = mat[k];
+		rec.material_id = material_id[k];
+		return rec;
+	}
+
+	void set(size_t k, const HitRecord& rec) {
+		t[k] = rec.t;
+		p_x[k] = rec.p.x(); p_y[k] = rec.p.y(); p_z[k] = rec.p.z();
+		normal_x[k] = rec.normal.x(); normal_y[k] = rec.normal.y(); normal_z[k] = rec.normal.z();
+		u[k] = rec.u;
+		v[k] = rec.v;
+		front_face[k] = rec.front_face ? 1 : 0;
+		mat[k] = rec.mat;
+		material_id[k] = rec.material_id;
+	}
+};
+
+/*
+	RayQueue
+	- indices into a PathBuffer of the paths waiting for the next stage
+	- stages running on several threads append with push(), which only bumps an atomic counter
+*/
+class RayQueue
+{
+public:
+	void reserve(size_t n) { items.resize(n); }
+	void clear() { count = 0; }
+
+	size_t size() const { return count; }
+	uint32_t operator[](size_t k) const { return items[k]; }
+
+	void push(uint32_t path) { items[count++] = path; }
+
+	// for a stage that places every path itself: resize() first, then set() each slot once
+	void resize(size_t n) { count = n; }
+	void set(size_t k, uint32_t path) { items[k] = path; }
+
+	// appends a whole block at once, one atomic add per block instead of per path
+	void push(const uint32_t* paths, size_t n) {
+		size_t at = count.fetch_add(n);
+		std::copy(paths, paths + n, items.begin() + at);
+	}
+
+	uint32_t* begin() { return items.data(); }
+	uint32_t* end() { return items.data() + count; }
+
+private:
+	std::vector<uint32_t> items;
+	std::atomic<size_t> count{ 0 };
+};
+
+/*
+	ChunkScratch
+	- the output of one stage of WorkStealingScheduler::parallel_for before it goes to a queue
+	- chunk c writes its paths from slot c * grain on and counts them per bucket (e.g. per material),
+	  so a second pass can place them in bucket order without sorting and no chunk allocates
+*/
+struct ChunkScratch
+{
+	std::vector<uint32_t> paths;
+	std::vector<size_t> sizes; // paths written by each chunk
+	std::vector<size_t> counts; // [chunk * buckets + bucket], after place() the queue slot of that run
+	size_t buckets = 1;
+
+	void reserve(size_t n) { paths.resize(n); }
+
+	// for a stage over n items in chunks of grain
+	void reset(size_t n, size_t grain, size_t bucket_count) {
+		size_t chunks = (n + grain - 1) / grain;
+		buckets = bucket_count;
+		sizes.assign(chunks, 0);
+		counts.assign(chunks * buckets, 0);
+	}
+
+	// turns the counts into the slot where each run starts: bucket 0 of every chunk in chunk order, then bucket 1, ...
+	// returns the number of paths
+	size_t place() {
+		size_t chunks = sizes.size();
+		size_t total = 0;
+		for (size_t bucket = 0; bucket < buckets; bucket++) {
+			for (size_t chunk = 0; chunk < chunks; chunk++) {
+				size_t count = counts[chunk * buckets + bucket];
+				counts[chunk * buckets + bucket] = total;
+				total += count;
+			}
+		}
+		return total;
+	}
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "utilities.h"
+
+#include "Hittable.h"
+#include "HittableList.h"
+#include "LinearBVH.h"
+#include "RenderStats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX__)
+#define SRT_WIDE_BVH_AVX 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SRT_WIDE_BVH_SSE 1
+#endif
+
+#if defined(SRT_WIDE_BVH_AVX) || defined(SRT_WIDE_BVH_SSE)
+#include <immintrin.h>
+#endif
+
+/*
+	WideBVHNode
+	- N children per node, their bounds stored axis by axis (SoA) so one SIMD slab test covers all of them
+	- a child is an interior node (count == 0, child >= 0), a leaf (count > 0, child = first primitive)
+	  or an empty slot (count == 0, child == -1, empty bounds)
+*/
+template <int N>
+struct WideBVHNode
+{
+	float bounds_min[3][N];
+	float bounds_max[3][N];
+	int32_t child[N];
+	uint16_t count[N];
+};
+
+/*
+	WideBVH
+	- BVH4 / BVH8 collapsed from the binary LinearBVH
+	- every visited node tests the ray against all of its children at once with SSE (4 wide) or AVX (8 wide)
+*/
+template <int N>
+class WideBVH : public Hittable
+{
+	static_assert(N == 4 || N == 8, "WideBVH supports 4 or 8 children per node");
+
+public:
+	WideBVH(const HittableList& list, const BVHBuildOptions& options = BVHBuildOptions())
+		: WideBVH(LinearBVH(list, options)) {}
+
+	WideBVH(const LinearBVH& binary) : primitives(binary.get_primitives()) {
+		const auto& binary_nodes = binary.get_nodes();
+		if (binary_nodes.empty()) return;
+
+		bbox = binary.bounding_box();
+		nodes.reserve(binary_nodes.size() / (N / 2) + 1);
+		collapse(binary_nodes, 0);
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+		if (nodes.empty())
+			return false;
+
+		TraversalRay ray(r);
+		StackEntry stack[max_stack_depth];
+		int stack_size = 0;
+		stack[stack_size++] = StackEntry{ static_cast<float>(ray_t.min), 0, 0 };
+
+		bool hit_anything = false;
+		while (stack_size > 0) {
+			StackEntry entry = stack[--stack_size];
+			// a closer hit has been found since this entry was pushed
+			if (entry.tnear * (1 - 2 * gamma3) > ray_t.max)
+				continue;
+
+			if (entry.count > 0) {
+				for (int k = 0; k < entry.count; k++) {
+					if (primitives[entry.index + k]->hit(r, ray_t, rec)) {
+						hit_anything = true;
+						ray_t.max = rec.t;
+					}
+				}
+				continue;
+			}
+
+			const auto& node = nodes[entry.index];
+			SRT_STAT(bvh_nodes_visited);
+			SRT_STAT_ADD(aabb_tests, N);
+			float tnear[N];
+			int mask = intersect_children(node, ray, ray_t, tnear);
+
+			// push far to near, so the nearest child is popped first
+			int order[N];
+			int hits = 0;
+			for (int k = 0; k < N; k++) {
+				if (!(mask & (1 << k))) continue;
+				int at = hits++;
+				while (at > 0 && tnear[order[at - 1]] < tnear[k]) {
+					order[at] = order[at - 1];
+					at--;
+				}
+				order[at] = k;
+			}
+			for (int h = 0; h < hits; h++) {
+				int k = order[h];
+				stack[stack_size++] = StackEntry{ tnear[k], node.child[k], node.count[k] };
+			}
+		}
+
+		return hit_anything;
+	}
+
+	AABB bounding_box() const override { return bbox; }
+
+	void bind_materials(MaterialTable& table) const override {
+		for (const auto& primitive : primitives)
+			primitive->bind_materials(table);
+	}
+
+	size_t node_count() const { return nodes.size(); }
+
+	// every node pushes at most N - 1 siblings before descending, and the collapsed tree is no deeper than the binary one
+	static const int max_stack_depth = LinearBVH::max_stack_depth * N;
+
+private:
+	struct StackEntry {
+		float tnear;
+		int32_t index;
+		int32_t count; // > 0 for leaves
+	};
+
+	// single precision copy of the ray's precomputed origin, reciprocal direction and signs
+	struct TraversalRay {
+		float origin[3];
+		float inv_dir[3];
+		bool negative[3];
+
+		TraversalRay(const Ray& r) {
+			for (int a = 0; a < 3; a++) {
+				origin[a] = static_cast<float>(r.origin()[a]);
+				inv_dir[a] = static_cast<float>(r.inv_direction()[a]);
+				negative[a] = r.sign(a) != 0;
+			}
+		}
+	};
+
+	// bound on the rounding error of the float slab test, as in pbrt
+	static constexpr float gamma3 = 3 * std::numeric_limits<float>::epsilon() * 0.5f / (1 - 3 * std::numeric_limits<float>::epsilon() * 0.5f);
+
+	std::vector<WideBVHNode<N>> nodes;
+	std::vector<shared_ptr<Hittable>> primitives;
+	AABB bbox;
+
+	// returns the bitmask of children whose box the ray enters within ray_t, with their entry distance
+	static int intersect_children(const WideBVHNode<N>& node, const TraversalRay& ray, const Interval& ray_t, float* tnear_out) {
+#if defined(SRT_WIDE_BVH_AVX)
+		if (N == 8) {
+			__m256 tnear = _mm256_set1_ps(static_cast<float>(ray_t.min));
+			__m256 tfar = _mm256_set1_ps(static_cast<float>(ray_t.max));
+			for (int a = 0; a < 3; a++) {
+				const float* near_plane = ray.negative[a] ? node.bounds_max[a] : node.bounds_min[a];
+				const float* far_plane = ray.negative[a] ? node.bounds_min[a] : node.bounds_max[a];
+				__m256 o = _mm256_set1_ps(ray.origin[a]);
+				__m256 inv = _mm256_set1_ps(ray.inv_dir[a]);
+				__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(near_plane), o), inv);
+				__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(far_plane), o), inv);
+				// a NaN slab (0 * inf) must not narrow the interval: max/min return their second operand on NaN
+				tnear = _mm256_max_ps(t0, tnear);
+				tfar = _mm256_min_ps(t1, tfar);
+			}
+			tfar = _mm256_mul_ps(tfar, _mm256_set1_ps(1 + 2 * gamma3));
+			_mm256_storeu_ps(tnear_out, tnear);
+			return _mm256_movemask_ps(_mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ));
+		}
+#endif
+#if defined(SRT_WIDE_BVH_SSE)
+		int mask = 0;
+		for (int block = 0; block < N; block += 4) {
+			__m128 tnear = _mm_set1_ps(static_cast<float>(ray_t.min));
+			__m128 tfar = _mm_set1_ps(static_cast<float>(ray_t.max));
+			for (int a = 0; a < 3; a++) {
+				const float* near_plane = ray.negative[a] ? node.bounds_max[a] : node.bounds_min[a];
+				const float* far_plane = ray.negative[a] ? node.bounds_min[a] : node.bounds_max[a];
+				__m128 o = _mm_set1_ps(ray.origin[a]);
+				__m128 inv = _mm_set1_ps(ray.inv_dir[a]);
+				__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(near_plane + block), o), inv);
+				__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(far_plane + block), o), inv);
+				tnear = _mm_max_ps(t0, tnear);
+				tfar = _mm_min_ps(t1, tfar);
+			}
+			tfar = _mm_mul_ps(tfar, _mm_set1_ps(1 + 2 * gamma3));
+			_mm_storeu_ps(tnear_out + block, tnear);
+			mask |= _mm_movemask_ps(_mm_cmple_ps(tnear, tfar)) << block;
+		}
+		return mask;
+#else
+		int mask = 0;
+		for (int k = 0; k < N; k++) {
+			float tnear = static_cast<float>(ray_t.min);
+			float tfar = static_cast<float>(ray_t.max);
+			for (int a = 0; a < 3; a++) {
+				float near_plane = ray.negative[a] ? node.bounds_max[a][k] : node.bounds_min[a][k];
+				float far_plane = ray.negative[a] ? node.bounds_min[a][k] : node.bounds_max[a][k];
+				float t0 = (near_plane - ray.origin[a]) * ray.inv_dir[a];
+				float t1 = (far_plane - ray.origin[a]) * ray.inv_dir[a];
+				if (t0 > tnear) tnear = t0;
+				if (t1 < tfar) tfar = t1;
+			}
+			tfar *= 1 + 2 * gamma3;
+			tnear_out[k] = tnear;
+			if (tnear <= tfar) mask |= 1 << k;
+		}
+		return mask;
+#endif
+	}
+
+	static float surface_area(const LinearBVHNode& node) {
+		float dx = node.bounds_max[0] - node.bounds_min[0];
+		float dy = node.bounds_max[1] - node.bounds_min[1];
+		float dz = node.bounds_max[2] - node.bounds_min[2];
+		return 2 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	// turns binary node `index` and up to N - 1 of its descendants into one wide node, returns its index
+	int collapse(const std::vector<LinearBVHNode>& binary_nodes, int index) {
+		// gather children: keep opening the largest interior child until there are N of them
+		int children[N];
+		int child_count = 0;
+		if (binary_nodes[index].primitive_count > 0) {
+			children[child_count++] = index; // a leaf root becomes the single child of the root
+		}
+		else {
+			children[child_count++] = index + 1;
+			children[child_count++] = binary_nodes[index].offset;
+		}
+
+		while (child_count < N) {
+			int widest = -1;
+			float widest_area = -1;
+			for (int k = 0; k < child_count; k++) {
+				const auto& node = binary_nodes[children[k]];
+				if (node.primitive_count == 0 && surface_area(node) > widest_area) {
+					widest = k;
+					widest_area = surface_area(node);
+				}
+			}
+			if (widest < 0) break;
+
+			int opened = children[widest];
+			children[widest] = opened + 1;
+			children[child_count++] = binary_nodes[opened].offset;
+		}
+
+		int wide_index = static_cast<int>(nodes.size());
+		nodes.push_back(WideBVHNode<N>());
+		for (int k = 0; k < N; k++) {
+			auto& wide = nodes[wide_index];
+			if (k >= child_count) {
+				for (int a = 0; a < 3; a++) {
+					wide.bounds_min[a][k] = std::numeric_limits<float>::infinity();
+					wide.bounds_max[a][k] = -std::numeric_limits<float>::infinity();
+				}
+				wide.child[k] = -1;
+				wide.count[k] = 0;
+				continue;
+			}
+
+			const auto& node = binary_nodes[children[k]];
+			for (int a = 0; a < 3; a++) {
+				wide.bounds_min[a][k] = node.bounds_min[a];
+				wide.bounds_max[a][k] = node.bounds_max[a];
+			}
+			if (node.primitive_count > 0) {
+				wide.child[k] = node.offset;
+				wide.count[k] = node.primitive_count;
+			}
+			else {
+				// nodes may reallocate while recursing, so write the child index through the index
+				int child_index = collapse(binary_nodes, children[k]);
+				nodes[wide_index].child[k] = child_index;
+				nodes[wide_index].count[k] = 0;
+			}
+		}
+		return wide_index;
+	}
+};
+
+using BVH4 = WideBVH<4>;
+using BVH8 = WideBVH<8>;
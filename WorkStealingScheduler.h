@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+	WorkStealingScheduler
+	- every worker owns a deque of tasks and works it from the front
+	- a worker that runs dry steals from the back of another worker's deque
+	- tasks may spawn more tasks; run() returns once every task has finished
+	- the worker threads live as long as the scheduler and sleep on a condition variable between and during runs
+	  when there is nothing to steal, so running many short passes does not respawn threads
+*/
+class WorkStealingScheduler
+{
+public:
+	using Task = std::function<void()>;
+
+	struct WorkerStats {
+		int tasks_run = 0;
+		int tasks_stolen = 0;
+		double busy_seconds = 0; // time spent inside tasks
+		double idle_seconds = 0; // time spent looking for work or waiting for the others to finish
+	};
+
+	explicit WorkStealingScheduler(int thread_count) {
+		int hardware = static_cast<int>(std::thread::hardware_concurrency());
+		int n = (thread_count > 0) ? thread_count : hardware;
+		n = (n < 1) ? 1 : n;
+
+		for (int w = 0; w < n; w++)
+			queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+		stats.resize(n);
+
+		workers.reserve(n);
+		for (int w = 0; w < n; w++)
+			workers.emplace_back([this, w]() { worker_loop(w); });
+	}
+
+	~WorkStealingScheduler() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		work_available.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+	WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+	int worker_count() const { return static_cast<int>(queues.size()); }
+
+	// split the initial tasks into one contiguous block per worker and run them all.
+	// not reentrant: call it from one thread at a time, and never from inside a task
+	void run(std::vector<Task> tasks) {
+		int n = worker_count();
+		std::fill(stats.begin(), stats.end(), WorkerStats());
+		auto start = std::chrono::steady_clock::now();
+
+		// counted before they are queued, so a worker never sleeps while a task waits in some deque
+		pending = static_cast<int>(tasks.size());
+		queued = static_cast<int>(tasks.size());
+		size_t block = (tasks.size() + n - 1) / n;
+		for (int w = 0; w < n; w++) {
+			size_t begin = std::min(tasks.size(), w * block);
+			size_t end = std::min(tasks.size(), begin + block);
+			std::lock_guard<std::mutex> lock(queues[w]->mutex);
+			for (size_t t = begin; t < end; t++)
+				queues[w]->tasks.push_back(std::move(tasks[t]));
+		}
+		wake_workers();
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			all_done.wait(lock, [this]() { return pending == 0; });
+		}
+
+		double wall = seconds_since(start);
+		for (auto& s : stats)
+			s.idle_seconds = std::max(0.0, wall - s.busy_seconds);
+	}
+
+	// run body(begin, end) over [0, count) in chunks of at most grain indices
+	void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+		grain = (grain < 1) ? 1 : grain;
+		std::vector<Task> tasks;
+		tasks.reserve((count + grain - 1) / grain);
+		for (size_t begin = 0; begin < count; begin += grain) {
+			size_t end = std::min(count, begin + grain);
+			tasks.push_back([&body, begin, end]() { body(begin, end); });
+		}
+		run(std::move(tasks));
+	}
+
+	// queue a task on the calling worker. only valid from inside a running task.
+	static void spawn(Task task) {
+		auto& self = current();
+		self.scheduler->pending++;
+		self.scheduler->queued++;
+		{
+			auto& queue = *self.scheduler->queues[self.worker];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_front(std::move(task));
+		}
+		self.scheduler->wake_workers();
+	}
+
+	// true when called from inside a task of some scheduler
+	static bool in_worker() { return current().scheduler != nullptr; }
+
+	const std::vector<WorkerStats>& get_worker_stats() const { return stats; }
+
+private:
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	struct WorkerContext {
+		WorkStealingScheduler* scheduler = nullptr;
+		int worker = 0;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<WorkerStats> stats;
+	std::vector<std::thread> workers;
+	std::atomic<int> pending{ 0 }; // tasks of the current run not finished yet
+	std::atomic<int> queued{ 0 };  // tasks sitting in some deque, at least as many as there really are
+
+	// guards the sleeping and waking of the workers and of run()
+	std::mutex mutex;
+	std::condition_variable work_available;
+	std::condition_variable all_done;
+	bool stopping = false;
+
+	static WorkerContext& current() {
+		thread_local WorkerContext context;
+		return context;
+	}
+
+	static double seconds_since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// taking the mutex orders the notify after a check a worker may be doing before it sleeps
+	void wake_workers() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		work_available.notify_all();
+	}
+
+	bool pop_front(int w, Task& task) {
+		auto& queue = *queues[w];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) return false;
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+		return true;
+	}
+
+	bool steal_back(int victim, Task& task) {
+		auto& queue = *queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) return false;
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	void worker_loop(int w) {
+		current().scheduler = this;
+		current().worker = w;
+
+		int n = worker_count();
+		auto& s = stats[w];
+		Task task;
+
+		while (true) {
+			bool found = pop_front(w, task);
+			// look for work starting at the next worker, so thieves spread over the victims
+			for (int k = 1; !found && k < n; k++) {
+				if (steal_back((w + k) % n, task)) {
+					found = true;
+					s.tasks_stolen++;
+				}
+			}
+
+			if (!found) {
+				// nothing to take: sleep until run() or spawn() queues more, or the scheduler goes away
+				std::unique_lock<std::mutex> lock(mutex);
+				work_available.wait(lock, [this]() { return stopping || queued > 0; });
+				if (stopping)
+					break;
+				continue;
+			}
+			queued--;
+
+			auto start = std::chrono::steady_clock::now();
+			task();
+			s.busy_seconds += seconds_since(start);
+			s.tasks_run++;
+			task = nullptr;
+
+			if (--pending == 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				all_done.notify_all();
+			}
+		}
+
+		current() = WorkerContext();
+	}
+};
@@ -0,0 +1,308 @@
+#include "utilities.h"
+
+#include "Accelerator.h"
+#include "Camera.h"
+#include "Scenes.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// renders the demo scenes at a fixed resolution, seed and sample count and reports their throughput:
+// benchmark [--scene NAME]... [--width N] [--spp N] [--seed N] [--threads N]
+//           [--bvh node|linear|bvh4|bvh8] [--split median|sah] [--materials table|virtual]
+//           [--shading immediate|sorted] [--integrator tiles|wavefront] [--packets N]
+//           [--pack-spheres on|off] [--leaf-size N] [--images on|off] [--json PATH] [--label TEXT]
+// --images on writes each scene to benchmark_<scene>.ppm, by default nothing is written but the json.
+// --packets only changes the traversal with --bvh linear and the tiles integrator with immediate shading, every other
+// combination traces the packet ray by ray (packet_traversal in the json tells which one ran)
+// all scenes run in one process, so the peak memory of a scene includes the scenes before it; pass a single
+// --scene to measure one on its own
+
+struct BenchmarkResult {
+    std::string scene;
+    int width = 0;
+    int height = 0;
+    int samples_per_pixel = 0;
+    size_t objects = 0;
+    double build_seconds = 0;
+    double render_seconds = 0;
+    long long samples = 0;
+    long long rays = 0;
+    long long process_peak_memory_kb = 0; // of the process up to the end of this scene, not of the scene alone
+    std::vector<std::pair<std::string, MaterialShadingStats>> shading; // per material type, only with --shading sorted
+};
+
+// high-water mark of the whole process so far, 0 when the platform cannot tell
+long long peak_memory_kb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return static_cast<long long>(counters.PeakWorkingSetSize / 1024);
+    return 0;
+#elif defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return static_cast<long long>(usage.ru_maxrss / 1024); // bytes on macOS
+#else
+    return static_cast<long long>(usage.ru_maxrss);
+#endif
+#else
+    return 0;
+#endif
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// swallows the render progress output while a scene runs
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+BenchmarkResult run_scene(Scene& scene, BVHType bvh_type, const BVHBuildOptions& bvh_options) {
+    BenchmarkResult result;
+    result.scene = scene.name;
+    result.objects = scene.objects.objects.size();
+
+    NullBuffer null_buffer;
+    std::streambuf* log = std::clog.rdbuf(&null_buffer);
+
+    auto build_start = std::chrono::steady_clock::now();
+    auto world = build_world(scene, bvh_type, bvh_options);
+    result.build_seconds = seconds_since(build_start);
+
+    auto render_start = std::chrono::steady_clock::now();
+    scene.cam.render(*world);
+    result.render_seconds = seconds_since(render_start);
+
+    std::clog.rdbuf(log);
+
+    const Framebuffer& framebuffer = scene.cam.get_framebuffer();
+    result.width = framebuffer.width();
+    result.height = framebuffer.height();
+    result.samples_per_pixel = scene.cam.samples_per_pixel;
+    for (size_t p = 0; p < framebuffer.pixel_count(); p++)
+        result.samples += framebuffer.sample_count(p);
+    result.rays = scene.cam.get_ray_count();
+    result.process_peak_memory_kb = peak_memory_kb();
+    result.shading = scene.cam.get_shading_stats_by_type();
+    return result;
+}
+
+double per_second(long long count, double seconds) {
+    return (seconds > 0) ? count / seconds : 0.0;
+}
+
+std::string json_string(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// frustum when the packets are walked together, per-ray when they are traced one ray at a time, none without packets
+const char* packet_traversal_name(BVHType bvh_type, bool sorted_shading, bool wavefront, int packet_size) {
+    if (packet_size <= 1)
+        return "none";
+    return (bvh_type == BVHType::Linear && !sorted_shading && !wavefront) ? "frustum" : "per-ray";
+}
+
+std::string to_json(const std::vector<BenchmarkResult>& results, const std::string& label, unsigned int seed,
+    int threads, BVHType bvh_type, const BVHBuildOptions& bvh_options, bool material_table, bool sorted_shading, bool wavefront, int packet_size) {
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\n";
+    out << "  \"label\": " << json_string(label) << ",\n";
+    out << "  \"seed\": " << seed << ",\n";
+    out << "  \"threads\": " << TileScheduler::resolve_thread_count(threads) << ",\n";
+    out << "  \"bvh\": " << json_string(bvh_type_name(bvh_type)) << ",\n";
+    out << "  \"split\": " << json_string(split_method_name(bvh_options.split_method)) << ",\n";
+    out << "  \"max_leaf_size\": " << bvh_options.max_leaf_size << ",\n";
+    out << "  \"pack_spheres\": " << (bvh_options.pack_spheres ? "true" : "false") << ",\n";
+    out << "  \"materials\": " << json_string(material_table ? "table" : "virtual") << ",\n";
+    out << "  \"shading\": " << json_string(sorted_shading ? "sorted" : "immediate") << ",\n";
+    out << "  \"integrator\": " << json_string(wavefront ? "wavefront" : "tiles") << ",\n";
+    out << "  \"packet_size\": " << packet_size << ",\n";
+    out << "  \"packet_traversal\": " << json_string(packet_traversal_name(bvh_type, sorted_shading, wavefront, packet_size)) << ",\n";
+    out << "  \"scenes\": [\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const auto& r = results[k];
+        out << "    {\n";
+        out << "      \"name\": " << json_string(r.scene) << ",\n";
+        out << "      \"width\": " << r.width << ",\n";
+        out << "      \"height\": " << r.height << ",\n";
+        out << "      \"samples_per_pixel\": " << r.samples_per_pixel << ",\n";
+        out << "      \"objects\": " << r.objects << ",\n";
+        out << "      \"build_seconds\": " << r.build_seconds << ",\n";
+        out << "      \"render_seconds\": " << r.render_seconds << ",\n";
+        out << "      \"samples\": " << r.samples << ",\n";
+        out << "      \"rays\": " << r.rays << ",\n";
+        out << "      \"samples_per_second\": " << per_second(r.samples, r.render_seconds) << ",\n";
+        out << "      \"rays_per_second\": " << per_second(r.rays, r.render_seconds) << ",\n";
+        out << "      \"process_peak_memory_kb\": " << r.process_peak_memory_kb << ",\n";
+        out << "      \"shading\": [";
+        for (size_t m = 0; m < r.shading.size(); m++) {
+            const auto& s = r.shading[m].second;
+            out << (m ? ", " : "") << "{ \"material\": " << json_string(r.shading[m].first) << ", \"scatters\": " << s.scatters
+                << ", \"seconds\": " << s.seconds << ", \"scatters_per_second\": " << per_second(s.scatters, s.seconds) << " }";
+        }
+        out << "]\n";
+        out << "    }" << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+    return out.str();
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> scenes;
+    int width = 200;
+    int samples_per_pixel = 16;
+    unsigned int seed = 0;
+    int threads = 0;
+    BVHType bvh_type = BVHType::Linear;
+    BVHBuildOptions bvh_options;
+    bvh_options.split_method = BVHSplitMethod::SAH;
+    bool material_table = true;
+    bool sorted_shading = false;
+    bool wavefront = false;
+    int packet_size = 0;
+    bool write_images = false;
+    std::string json_path;
+    std::string label;
+
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (a + 1 >= argc) {
+            std::cerr << "missing value for '" << arg << "'\n";
+            return 1;
+        }
+        std::string value = argv[++a];
+
+        if (arg == "--scene") scenes.push_back(value);
+        else if (arg == "--width") width = std::atoi(value.c_str());
+        else if (arg == "--spp") samples_per_pixel = std::atoi(value.c_str());
+        else if (arg == "--seed") seed = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (arg == "--threads") threads = std::atoi(value.c_str());
+        else if (arg == "--packets") packet_size = std::atoi(value.c_str());
+        else if (arg == "--leaf-size") bvh_options.max_leaf_size = std::atoi(value.c_str());
+        else if (arg == "--pack-spheres") {
+            if (value != "on" && value != "off") {
+                std::cerr << "unknown value '" << value << "' for --pack-spheres, expected on or off\n";
+                return 1;
+            }
+            bvh_options.pack_spheres = (value == "on");
+        }
+        else if (arg == "--images") {
+            if (value != "on" && value != "off") {
+                std::cerr << "unknown value '" << value << "' for --images, expected on or off\n";
+                return 1;
+            }
+            write_images = (value == "on");
+        }
+        else if (arg == "--json") json_path = value;
+        else if (arg == "--label") label = value;
+        else if (arg == "--bvh") {
+            if (!bvh_type_from_name(value, bvh_type)) {
+                std::cerr << "unknown bvh type '" << value << "', expected node, linear, bvh4 or bvh8\n";
+                return 1;
+            }
+        }
+        else if (arg == "--split") {
+            if (!split_method_from_name(value, bvh_options.split_method)) {
+                std::cerr << "unknown split method '" << value << "', expected median or sah\n";
+                return 1;
+            }
+        }
+        else if (arg == "--materials") {
+            if (value != "table" && value != "virtual") {
+                std::cerr << "unknown material dispatch '" << value << "', expected table or virtual\n";
+                return 1;
+            }
+            material_table = (value == "table");
+        }
+        else if (arg == "--shading") {
+            if (value != "immediate" && value != "sorted") {
+                std::cerr << "unknown shading order '" << value << "', expected immediate or sorted\n";
+                return 1;
+            }
+            sorted_shading = (value == "sorted");
+        }
+        else if (arg == "--integrator") {
+            if (value != "tiles" && value != "wavefront") {
+                std::cerr << "unknown integrator '" << value << "', expected tiles or wavefront\n";
+                return 1;
+            }
+            wavefront = (value == "wavefront");
+        }
+        else {
+            std::cerr << "unknown option '" << arg << "'\n";
+            return 1;
+        }
+    }
+    if (scenes.empty())
+        scenes = scene_names();
+    if (std::string(packet_traversal_name(bvh_type, sorted_shading, wavefront, packet_size)) == "per-ray")
+        std::cerr << "note: --packets only walks packets together with --bvh linear and the tiles integrator with immediate shading, "
+            << "this run traces them ray by ray\n";
+
+    std::vector<BenchmarkResult> results;
+    for (const auto& name : scenes) {
+        Scene scene;
+        if (!make_scene(name, scene)) {
+            std::cerr << "unknown scene '" << name << "'\n";
+            return 1;
+        }
+        scene.cam.image_width = width;
+        scene.cam.samples_per_pixel = samples_per_pixel;
+        scene.cam.seed = seed;
+        scene.cam.thread_count = threads;
+        scene.cam.use_material_table = material_table;
+        scene.cam.sort_by_material = sorted_shading;
+        scene.cam.wavefront = wavefront;
+        scene.cam.packet_size = packet_size;
+        scene.cam.output_path = write_images ? "benchmark_" + name + ".ppm" : "";
+
+        BenchmarkResult r = run_scene(scene, bvh_type, bvh_options);
+        results.push_back(r);
+        std::cout << r.scene << ": " << r.width << "x" << r.height << " @ " << r.samples_per_pixel << " spp, "
+            << "build " << r.build_seconds * 1000 << " ms, render " << r.render_seconds << " s, "
+            << per_second(r.rays, r.render_seconds) / 1e6 << " Mrays/s, "
+            << per_second(r.samples, r.render_seconds) / 1e6 << " Msamples/s, "
+            << "process peak " << r.process_peak_memory_kb / 1024 << " MB\n";
+        for (const auto& type : r.shading)
+            std::cout << "  " << type.first << ": " << type.second.scatters << " scatters, "
+                << per_second(type.second.scatters, type.second.seconds) / 1e6 << " Mscatters/s\n";
+    }
+
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        out << to_json(results, label, seed, threads, bvh_type, bvh_options, material_table, sorted_shading, wavefront, packet_size);
+        if (!out) {
+            std::cerr << "ERROR: Could not write benchmark results to '" << json_path << "'.\n";
+            return 1;
+        }
+    }
+    return 0;
+}
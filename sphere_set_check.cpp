@@ -0,0 +1,170 @@
+#include "utilities.h"
+
+#include "Hittable.h"
+#include "Material.h"
+#include "Sphere.h"
+#include "SphereSet.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// checks that SphereSet::hit gives the very same hits as testing its spheres one by one with Sphere::hit,
+// on every discriminant path the build has (scalar, SSE2, AVX). returns 1 on the first mismatching path:
+// sphere_set_check [--rays N]
+// build it with the flags of the renderer, and once more with FMA contraction on (e.g. -O3 -mavx2 -mfma),
+// which is what makes the SIMD and the scalar discriminants round differently
+
+const char* path_name(SphereSet::Path path) {
+    switch (path) {
+    case SphereSet::Path::AVX: return "avx";
+    case SphereSet::Path::SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+// a few spheres around center, radius up to max_radius, every third one moving
+std::vector<shared_ptr<Sphere>> make_spheres(const Point3& center, double spread, double max_radius, int count) {
+    auto material = make_shared<LambertianMaterial>(Color3(0.5, 0.5, 0.5));
+    std::vector<shared_ptr<Sphere>> spheres;
+    for (int k = 0; k < count; k++) {
+        Point3 c = center + spread * Vec3(random_double(-1, 1), random_double(-1, 1), random_double(-1, 1));
+        double radius = random_double(0.01, max_radius);
+        if (k % 3 == 0)
+            spheres.push_back(make_shared<Sphere>(c, c + Vec3(0, random_double(0, 1), 0), radius, material));
+        else
+            spheres.push_back(make_shared<Sphere>(c, radius, material));
+    }
+    return spheres;
+}
+
+// closest hit over the spheres one at a time, the way a HittableList finds it
+bool hit_each(const std::vector<shared_ptr<Sphere>>& spheres, const Ray& r, Interval ray_t, HitRecord& rec) {
+    bool hit_anything = false;
+    for (const auto& sphere : spheres) {
+        if (sphere->hit(r, ray_t, rec)) {
+            hit_anything = true;
+            ray_t.max = rec.t;
+        }
+    }
+    return hit_anything;
+}
+
+// camera-like rays from around center, secondary rays leaving a sphere surface, and rays grazing a sphere's silhouette
+Ray make_ray(const std::vector<shared_ptr<Sphere>>& spheres, const Point3& center, double spread, int kind) {
+    Point3 origin = center + spread * Vec3(random_double(-1, 1), random_double(-1, 1), random_double(-1, 1));
+    double time = random_double();
+    if (kind == 0)
+        return Ray(origin, random_unit_vector(thread_rng()), time);
+
+    // spheres only move along y, so the box gives the exact radius and, for the still ones, the exact center
+    const Sphere& target = *spheres[static_cast<size_t>(random_double(0, static_cast<double>(spheres.size())))];
+    AABB box = target.bounding_box();
+    Point3 target_center(0.5 * (box.x.min + box.x.max), 0.5 * (box.y.min + box.y.max), 0.5 * (box.z.min + box.z.max));
+    double target_radius = 0.5 * (box.x.max - box.x.min);
+
+    if (kind == 1) {
+        HitRecord rec;
+        if (target.hit(Ray(origin, target_center - origin, time), Interval(0.001, infinity), rec))
+            return Ray(rec.p, rec.normal + random_unit_vector(thread_rng()), time);
+        return Ray(origin, random_unit_vector(thread_rng()), time);
+    }
+
+    // tangent to the sphere, give or take a few ulps of the angle
+    Vec3 to_center = target_center - origin;
+    double distance = to_center.length();
+    if (distance <= target_radius)
+        return Ray(origin, random_unit_vector(thread_rng()), time);
+    Vec3 axis = to_center / distance;
+    Vec3 side = unit_vector(cross(axis, random_unit_vector(thread_rng())));
+    double sin_angle = target_radius / distance * (1 + 1e-15 * random_double(-8, 8));
+    double cos_angle = sqrt(std::max(0.0, 1 - sin_angle * sin_angle));
+    return Ray(origin, cos_angle * axis + sin_angle * side, time);
+}
+
+// bit for bit, so two NaNs agree (moving spheres take their normal from center1, which can push v out of acos' range)
+bool same(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// -1 when every ray agrees, otherwise the index of the first one that does not
+long long first_mismatch(const std::vector<shared_ptr<Sphere>>& spheres, const SphereSet& set, SphereSet::Path path,
+    const Point3& ray_center, double ray_spread, long long rays, long long& hits) {
+    for (long long k = 0; k < rays; k++) {
+        Ray r = make_ray(spheres, ray_center, ray_spread, static_cast<int>(k % 3));
+        HitRecord expected, got;
+        bool hit_expected = hit_each(spheres, r, Interval(0.001, infinity), expected);
+        bool hit_got = set.hit_on(path, r, Interval(0.001, infinity), got);
+        if (hit_expected != hit_got)
+            return k;
+        if (!hit_expected)
+            continue;
+        hits++;
+        bool identical = same(expected.t, got.t) && same(expected.u, got.u) && same(expected.v, got.v)
+            && expected.front_face == got.front_face && expected.mat == got.mat;
+        for (int axis = 0; axis < 3; axis++)
+            identical = identical && same(expected.p[axis], got.p[axis]) && same(expected.normal[axis], got.normal[axis]);
+        if (!identical)
+            return k;
+    }
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    long long rays = 200000;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--rays" && a + 1 < argc) {
+            rays = std::atoll(argv[++a]);
+        }
+        else {
+            std::cerr << "unknown option '" << arg << "'\n";
+            return 1;
+        }
+    }
+
+    struct Group {
+        const char* name;
+        Point3 center;
+        double spread;
+        double max_radius;
+        int count;
+        Point3 ray_center; // the rays start around here
+        double ray_spread;
+    };
+    // near the origin, far from it (small spheres at large coordinates lose the most bits), and a huge ground sphere
+    const Group groups[] = {
+        { "near", Point3(0, 0, 0), 10, 3, 11, Point3(0, 0, 0), 30 },
+        { "far", Point3(900, -400, 1300), 5, 0.5, 9, Point3(900, -400, 1300), 15 },
+        { "ground", Point3(0, -1000, 0), 0, 1000, 1, Point3(0, 1, 0), 20 },
+    };
+
+    const SphereSet::Path paths[] = { SphereSet::Path::Scalar, SphereSet::Path::SSE2, SphereSet::Path::AVX };
+    bool ok = true;
+    for (const auto& group : groups) {
+        auto spheres = make_spheres(group.center, group.spread, group.max_radius, group.count);
+        SphereSet set;
+        for (const auto& sphere : spheres)
+            set.add(*sphere);
+
+        for (auto path : paths) {
+            if (!SphereSet::has_path(path))
+                continue;
+            // every path sees the same rays
+            thread_rng() = RNG();
+            long long hits = 0;
+            long long mismatch = first_mismatch(spheres, set, path, group.ray_center, group.ray_spread, rays, hits);
+            if (mismatch >= 0) {
+                std::cerr << "ERROR: " << path_name(path) << " differs from Sphere::hit on ray " << mismatch << " of the " << group.name << " spheres.\n";
+                ok = false;
+            }
+            else {
+                std::cout << group.name << " " << path_name(path) << ": " << rays << " rays, " << hits << " hits, identical\n";
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
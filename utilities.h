@@ -6,6 +6,8 @@
 #include <limits>
 #include <memory>
 
+#include "Random.h"
+
 // usings
 using std::shared_ptr;
 using std::make_shared;
@@ -20,17 +22,34 @@ inline double double_degree_to_radians(double degree) {
 	return degree * pi / 180.0;
 }
 
-inline double random_double() {
-	return rand() / (RAND_MAX + 1.0);
+inline double random_double(RNG& rng) {
+	return rng.next_double();
+}
+
+inline double random_double(RNG& rng, double min, double max) {
+	return min + (max-min)*random_double(rng);
+}
+
+inline int random_int(RNG& rng, int min, int max) {
+	return static_cast<int>(random_double(rng, min, max+1)); // [min, max+1)
+}
+
+// generator of the calling thread, for scene setup outside of rendering
+inline RNG& thread_rng() {
+	thread_local RNG rng;
+	return rng;
 }
 
+inline double random_double() {
+	return random_double(thread_rng());
+}
 
 inline double random_double(double min, double max) {
-	return min + (max-min)*random_double();
+	return random_double(thread_rng(), min, max);
 }
 
 inline int random_int(int min, int max) {
-	return static_cast<int>(random_double(min, max+1)); // [min, max+1)
+	return random_int(thread_rng(), min, max);
 }
 
 // common Headers